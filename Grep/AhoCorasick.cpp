@@ -0,0 +1,135 @@
+#include "AhoCorasick.h"
+#include <algorithm>
+#include <map>
+#include <queue>
+
+namespace {
+
+const uint32_t kNone = 0xffffffffu;
+
+}
+
+AhoCorasick::AhoCorasick(const std::vector<std::string>& needles, bool ignoreCase) : maxLength(0) {
+    for (int c = 0; c < 256; ++c) {
+        fold[c] = (ignoreCase && c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+
+    // Build the trie with ordered maps first, then flatten it into sorted edge runs
+    std::vector<std::map<unsigned char, uint32_t>> trie(1);
+    std::vector<uint32_t> ownLength(1, 0);
+    for (const auto& needle : needles) {
+        if (needle.empty()) continue;
+        uint32_t state = 0;
+        for (unsigned char c : needle) {
+            c = fold[c];
+            auto it = trie[state].find(c);
+            if (it == trie[state].end()) {
+                uint32_t next = trie.size();
+                trie[state][c] = next;
+                trie.emplace_back();
+                ownLength.push_back(0);
+                state = next;
+            } else {
+                state = it->second;
+            }
+        }
+        ownLength[state] = needle.size();
+        maxLength = std::max(maxLength, needle.size());
+    }
+
+    nodes.resize(trie.size());
+    for (size_t s = 0; s < trie.size(); ++s) {
+        nodes[s].firstEdge = edges.size();
+        nodes[s].edgeCount = trie[s].size();
+        nodes[s].fail = 0;
+        nodes[s].dictLink = 0;
+        nodes[s].ownLength = ownLength[s];
+        nodes[s].longest = ownLength[s];
+        for (const auto& edge : trie[s]) edges.push_back({edge.first, edge.second});
+    }
+
+    for (int c = 0; c < 256; ++c) rootNext[c] = 0;
+    for (const auto& edge : trie[0]) rootNext[edge.first] = edge.second;
+
+    // Breadth-first so every fail target is final before it is used
+    std::queue<uint32_t> pending;
+    for (const auto& edge : trie[0]) pending.push(edge.second);
+    while (!pending.empty()) {
+        uint32_t state = pending.front();
+        pending.pop();
+        for (const auto& edge : trie[state]) {
+            uint32_t next = edge.second;
+            uint32_t fail = step(nodes[state].fail, edge.first);
+            nodes[next].fail = fail;
+            nodes[next].dictLink = nodes[fail].ownLength ? fail : nodes[fail].dictLink;
+            nodes[next].longest = std::max(nodes[next].ownLength, nodes[fail].longest);
+            pending.push(next);
+        }
+    }
+}
+
+uint32_t AhoCorasick::child(uint32_t state, unsigned char byte) const {
+    const Node& node = nodes[state];
+    const Edge* first = edges.data() + node.firstEdge;
+    const Edge* last = first + node.edgeCount;
+    if (node.edgeCount <= 8) {
+        for (const Edge* e = first; e < last; ++e) {
+            if (e->byte == byte) return e->target;
+        }
+        return kNone;
+    }
+    const Edge* e = std::lower_bound(first, last, byte,
+                                     [](const Edge& edge, unsigned char b) { return edge.byte < b; });
+    return (e != last && e->byte == byte) ? e->target : kNone;
+}
+
+uint32_t AhoCorasick::step(uint32_t state, unsigned char byte) const {
+    while (state != 0) {
+        uint32_t next = child(state, byte);
+        if (next != kNone) return next;
+        state = nodes[state].fail;
+    }
+    return rootNext[byte];
+}
+
+bool AhoCorasick::find(std::string_view text, size_t& begin, size_t& end, AcceptFn accept) const {
+    bool found = false;
+    size_t bestBegin = 0;
+    size_t bestEnd = 0;
+    uint32_t state = 0;
+
+    for (size_t pos = 0; pos < text.size(); ++pos) {
+        // Once past bestBegin + maxLength no later match can start further left
+        if (found && pos >= bestBegin + maxLength) break;
+
+        state = step(state, fold[static_cast<unsigned char>(text[pos])]);
+        if (nodes[state].longest == 0) continue;
+
+        if (!accept) {
+            size_t start = pos + 1 - nodes[state].longest;
+            if (!found || start <= bestBegin) {
+                found = true;
+                bestBegin = start;
+                bestEnd = pos + 1;
+            }
+            continue;
+        }
+
+        // With a filter every needle ending here is a separate candidate
+        for (uint32_t s = nodes[state].ownLength ? state : nodes[state].dictLink; s != 0; s = nodes[s].dictLink) {
+            size_t start = pos + 1 - nodes[s].ownLength;
+            if (found && start > bestBegin) continue;
+            if (accept(text, start, pos + 1)) {
+                found = true;
+                bestBegin = start;
+                bestEnd = pos + 1;
+            }
+        }
+    }
+
+    if (found) {
+        begin = bestBegin;
+        end = bestEnd;
+    }
+    return found;
+}
@@ -0,0 +1,49 @@
+#ifndef AHOCORASICK_H
+#define AHOCORASICK_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Multi-literal matcher: a trie of every needle with failure links, so a
+// line is scanned once no matter how many needles there are. The root keeps
+// a full 256-entry table since most bytes of a typical line never leave it.
+class AhoCorasick {
+public:
+    // Optional filter for candidate matches, e.g. whole-word checks
+    typedef bool (*AcceptFn)(std::string_view text, size_t begin, size_t end);
+
+    AhoCorasick(const std::vector<std::string>& needles, bool ignoreCase);
+
+    // Leftmost match, longest among those starting at the same byte
+    bool find(std::string_view text, size_t& begin, size_t& end, AcceptFn accept = nullptr) const;
+
+    size_t stateCount() const { return nodes.size(); }
+
+private:
+    struct Node {
+        uint32_t firstEdge;
+        uint32_t edgeCount;
+        uint32_t fail;
+        uint32_t dictLink;   // nearest state on the fail chain that ends a needle, 0 if none
+        uint32_t ownLength;  // length of the needle ending exactly here, 0 if none
+        uint32_t longest;    // longest needle ending here, own or via the fail chain
+    };
+
+    struct Edge {
+        unsigned char byte;
+        uint32_t target;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Edge> edges;
+    uint32_t rootNext[256];
+    unsigned char fold[256];
+    size_t maxLength;
+
+    uint32_t child(uint32_t state, unsigned char byte) const;
+    uint32_t step(uint32_t state, unsigned char byte) const;
+};
+
+#endif
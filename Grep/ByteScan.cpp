@@ -0,0 +1,50 @@
+#include "ByteScan.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+size_t ByteScan::countNewlines(const char* begin, const char* end) {
+    size_t count = 0;
+    const char* pos = begin;
+
+#if defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - pos >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        count += __builtin_popcount(mask);
+        pos += 16;
+    }
+#endif
+
+    for (; pos < end; ++pos) {
+        if (*pos == '\n') ++count;
+    }
+    return count;
+}
+
+bool ByteScan::isAscii(const char* begin, const char* end) {
+    const char* pos = begin;
+
+#if defined(__SSE2__)
+    // OR the blocks together and test the high bits once per 64 bytes
+    while (end - pos >= 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos + 48));
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)))) return false;
+        pos += 64;
+    }
+    while (end - pos >= 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos)))) return false;
+        pos += 16;
+    }
+#endif
+
+    for (; pos < end; ++pos) {
+        if (static_cast<unsigned char>(*pos) >= 0x80) return false;
+    }
+    return true;
+}
@@ -0,0 +1,14 @@
+#ifndef BYTESCAN_H
+#define BYTESCAN_H
+
+#include <cstddef>
+
+// Vectorised helpers for walking raw text buffers
+namespace ByteScan {
+    size_t countNewlines(const char* begin, const char* end);
+
+    // True if no byte has its high bit set, i.e. the text is plain ASCII
+    bool isAscii(const char* begin, const char* end);
+}
+
+#endif
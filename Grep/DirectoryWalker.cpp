@@ -0,0 +1,145 @@
+#include "DirectoryWalker.h"
+#include <algorithm>
+#include <condition_variable>
+#include <filesystem>
+#include <fnmatch.h>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+DirectoryWalker::DirectoryWalker(const GrepOptions& options)
+    : includeGlobs(options.includeGlobs), excludeGlobs(options.excludeGlobs),
+      threadCount(std::max(options.jobs, 1)) {}
+
+void DirectoryWalker::walk(const std::vector<std::string>& roots, PathQueue& queue,
+                           const std::atomic<bool>& cancelled) {
+    for (const auto& root : roots) {
+        if (cancelled) break;
+        std::error_code error;
+        if (fs::is_directory(root, error)) {
+            walkTree(root, queue, cancelled);
+        } else {
+            // Named files are searched even if a glob would have skipped them
+            queue.push(root);
+        }
+    }
+    queue.close();
+}
+
+namespace {
+
+// One directory of a tree being walked, listed or still waiting for a thread
+struct Listing {
+    fs::path path;
+    bool listed = false;
+    std::vector<std::string> files;
+    std::vector<std::unique_ptr<Listing>> subdirectories;
+};
+
+}
+
+void DirectoryWalker::walkTree(const std::string& root, PathQueue& queue, const std::atomic<bool>& cancelled) {
+    // The queue numbers paths in push order and results are printed in that
+    // order, so files are pushed in the order a serial walk finds them: a
+    // directory's files, then each subdirectory in listing order. Threads
+    // list directories in any order; a listing waits here until everything
+    // before it has been pushed.
+    Listing top;
+    top.listed = true;
+    top.subdirectories.push_back(std::make_unique<Listing>());
+    top.subdirectories.front()->path = root;
+    // The path from the top down to the listing pushed last, with the index
+    // of the next subdirectory to push at each level
+    std::vector<std::pair<Listing*, size_t>> cursor{{&top, 0}};
+
+    std::vector<Listing*> directories{top.subdirectories.front().get()};
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t busy = 0;
+
+    auto release = [&]() {
+        while (!cursor.empty()) {
+            Listing* parent = cursor.back().first;
+            size_t& next = cursor.back().second;
+            if (next == parent->subdirectories.size()) {
+                // Every subdirectory is pushed, so nothing refers to them any more
+                parent->subdirectories.clear();
+                cursor.pop_back();
+                continue;
+            }
+            Listing* listing = parent->subdirectories[next].get();
+            if (!listing->listed) return;
+            ++next;
+            for (auto& file : listing->files) queue.push(std::move(file));
+            listing->files.clear();
+            cursor.emplace_back(listing, 0);
+        }
+    };
+
+    auto work = [&]() {
+        while (true) {
+            Listing* listing;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() { return !directories.empty() || busy == 0 || cancelled; });
+                if (directories.empty() || cancelled) return;
+                listing = directories.back();
+                directories.pop_back();
+                ++busy;
+            }
+
+            std::vector<fs::path> found;
+            std::vector<std::string> files;
+            std::error_code error;
+            fs::directory_iterator it(listing->path, error), end;
+            if (error) {
+                std::cerr << "Could not open directory: " << listing->path.string() << "\n";
+            }
+            for (; !error && it != end; it.increment(error)) {
+                fs::file_status status = it->symlink_status(error);
+                if (error) break;
+                if (fs::is_directory(status)) {
+                    found.push_back(it->path());
+                } else if (fs::is_regular_file(status) && wanted(it->path().filename().string())) {
+                    files.push_back(it->path().string());
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                listing->files = std::move(files);
+                for (auto& path : found) {
+                    listing->subdirectories.push_back(std::make_unique<Listing>());
+                    listing->subdirectories.back()->path = std::move(path);
+                }
+                // Reversed so the stack hands them out in listing order, the
+                // order release() needs them in
+                for (auto it = listing->subdirectories.rbegin(); it != listing->subdirectories.rend(); ++it) {
+                    directories.push_back(it->get());
+                }
+                listing->listed = true;
+                release();
+                --busy;
+            }
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t) threads.emplace_back(work);
+    for (auto& thread : threads) thread.join();
+}
+
+bool DirectoryWalker::wanted(const std::string& name) const {
+    for (const auto& glob : excludeGlobs) {
+        if (fnmatch(glob.c_str(), name.c_str(), 0) == 0) return false;
+    }
+    if (includeGlobs.empty()) return true;
+    for (const auto& glob : includeGlobs) {
+        if (fnmatch(glob.c_str(), name.c_str(), 0) == 0) return true;
+    }
+    return false;
+}
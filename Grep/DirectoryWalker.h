@@ -0,0 +1,32 @@
+#ifndef DIRECTORYWALKER_H
+#define DIRECTORYWALKER_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "GrepOptions.h"
+#include "PathQueue.h"
+
+// Expands -r roots into the regular files beneath them. Directories are
+// listed by a small pool of threads sharing one stack of pending
+// directories. Files that pass --include/--exclude are pushed onto the
+// queue in the order a single thread would find them, as soon as every
+// directory before theirs has been listed. Symbolic links inside the tree
+// are not followed.
+class DirectoryWalker {
+public:
+    explicit DirectoryWalker(const GrepOptions& options);
+
+    // Closes the queue once everything has been walked or cancelled is raised
+    void walk(const std::vector<std::string>& roots, PathQueue& queue, const std::atomic<bool>& cancelled);
+
+private:
+    std::vector<std::string> includeGlobs;
+    std::vector<std::string> excludeGlobs;
+    size_t threadCount;
+
+    void walkTree(const std::string& root, PathQueue& queue, const std::atomic<bool>& cancelled);
+    bool wanted(const std::string& name) const;
+};
+
+#endif
@@ -1,98 +1,749 @@
 #include "GrepEngine.h"
-#include <fstream>
+#include "MappedFile.h"
+#include "ByteScan.h"
+#include "DirectoryWalker.h"
+#include "InputSource.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <fcntl.h>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
 
-GrepEngine::GrepEngine(const GrepOptions& options) : options(options) {
-    buffer.resize(options.beforeContext + options.afterContext + 1);
+namespace {
+
+// Serial runs hand output to the sink in blocks of roughly this size
+const size_t kFlushThreshold = 64 * 1024;
+
+// A mapped file at least twice this size is split into newline-aligned
+// chunks of roughly this many bytes when -j allows more than one thread
+const size_t kChunkSize = 16 * 1024 * 1024;
+
+// Unmappable inputs are read this many bytes at a time
+const size_t kReadBlock = 128 * 1024;
+
+// After this many candidate lines in a row with nothing skipped before them,
+// the next this many bytes are matched line by line without looking ahead
+const int kFutileSkips = 8;
+const size_t kSkipPause = 64 * 1024;
+
+// Under -r a file with a NUL byte this close to its start is taken as binary
+const size_t kBinarySniff = 32 * 1024;
+
+// "-" on the command line, and what its lines are labelled with
+const std::string kStandardInputPath = "-";
+const std::string kStandardInputLabel = "(standard input)";
+
+void appendNumber(std::string& out, long value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr - digits);
 }
 
-void GrepEngine::searchFiles(const std::vector<std::string>& files) {
-    for (const auto& file : files) {
-        searchInFile(file);
+}
+
+GrepEngine::GrepEngine(const GrepOptions& options)
+    : options(options), matcher(options), sink(STDOUT_FILENO), printedAny(false), anyMatch(false),
+      timing(options.stats), cancelled(false) {
+    printLines = !options.showCount && !options.onlyFilenames && !options.quiet;
+    // Someone is waiting on each line: a terminal, or a pipeline that asked for it
+    flushEachLine = sink.interactive() || options.lineBuffered;
+
+    // The index says where text is, so it cannot help -v
+    std::vector<std::vector<std::string>> literals;
+    for (const auto& alternative : matcher.requiredFactors()) {
+        literals.emplace_back();
+        for (const auto& factor : alternative) literals.back().push_back(factor.text);
     }
+    useIndex = !options.invertMatch && TrigramIndex::makeQuery(literals, indexQuery);
+    showContext = printLines && !options.onlyMatching && (options.beforeContext > 0 || options.afterContext > 0);
+    // Context and -v need every line, not just the ones that can match
+    // -v prints the stretches the gate steps over instead of dropping them
+    printSkipped = options.invertMatch && printLines && !options.onlyMatching && options.maxCount < 0;
+    skipLines = matcher.canSkip() && !showContext && (!options.invertMatch || printSkipped);
+    // Without -m nothing depends on where the matches are, only how many there are
+    countOnly = options.showCount && !options.onlyFilenames && !options.quiet && options.maxCount < 0;
 }
 
-void GrepEngine::searchInFile(const std::string& filename) {
-    std::ifstream infile(filename);
-    if (!infile.is_open()) {
-        std::cerr << "Could not open file: " << filename << std::endl;
-        return;
+GrepEngine::Worker GrepEngine::makeWorker() const {
+    Worker worker;
+    worker.ring.resize(std::max(options.beforeContext, 1));
+    worker.scratch = matcher.makeScratch();
+    return worker;
+}
+
+void GrepEngine::collect([[maybe_unused]] Worker& worker) {
+#if GREP_STATS
+    worker.stats.regexCalls += worker.scratch.regexCalls;
+    worker.scratch.regexCalls = 0;
+    worker.stats.threads = 1;
+    std::lock_guard<std::mutex> lock(statsMutex);
+    totals.add(worker.stats);
+#endif
+}
+
+Stats GrepEngine::stats() const {
+    Stats result = totals;
+    result.add(printing);
+    return result;
+}
+
+bool GrepEngine::searchFiles(const std::vector<std::string>& files) {
+    GREP_STAT(uint64_t started = Stats::now());
+    PathQueue queue;
+    std::thread walker;
+    if (options.recursive) {
+        // Workers start on the first files while the rest of the tree is still being listed
+        walker = std::thread([&]() { DirectoryWalker(options).walk(files, queue, cancelled); });
+    } else {
+        for (const auto& file : files) queue.push(file);
+        queue.close();
     }
 
-    std::string line;
-    int lineNumber = 0;
-    int matchCount = 0;
-    bool hasMatch = false;
+    if (options.jobs > 1 && (options.recursive || files.size() > 1)) {
+        searchQueueParallel(queue);
+    } else {
+        searchQueue(queue);
+    }
+
+    if (walker.joinable()) walker.join();
+    sink.flush();
+    GREP_STAT(printing.wallNanos = Stats::now() - started);
+    return anyMatch;
+}
+
+GrepEngine::FileScan GrepEngine::makeScan(const std::string& file, Worker& worker, bool streaming) const {
+    bool standardInput = file == kStandardInputPath;
+    FileScan scan{standardInput ? kStandardInputLabel : file, worker, streaming, {}, {}, 0, false};
+    scan.standardInput = standardInput;
+    return scan;
+}
+
+void GrepEngine::searchQueue(PathQueue& queue) {
+    Worker worker = makeWorker();
+    size_t index;
+    std::string file;
+    while (!cancelled && queue.pop(index, file)) {
+        FileScan scan = makeScan(file, worker, true);
+        searchInFile(scan);
+        GREP_STAT(uint64_t started = timing ? Stats::now() : 0);
+        flushOutput(scan);
+        GREP_STAT(if (timing) worker.stats.printNanos += Stats::now() - started);
+        if (scan.matchCount > 0) anyMatch = true;
+    }
+    collect(worker);
+}
+
+void GrepEngine::searchQueueParallel(PathQueue& queue) {
+    struct Result {
+        std::string output;
+        std::string errors;
+        long matchCount = 0;
+        bool leadingBreak = false;
+    };
 
-    while (std::getline(infile, line)) {
-        lineNumber++;
-        buffer[lineNumber % buffer.size()] = line;
+    // Finished files waiting for every earlier one to be printed
+    std::map<size_t, Result> results;
+    // Workers that find the queue empty count running down as soon as they
+    // start, so the loop starting them must not read it
+    const size_t workerCount = options.jobs;
+    size_t running = workerCount;
+    // Workers may search at most this many files ahead of the printer, so
+    // output held for printing stays bounded when an early file is slow
+    const size_t window = 2 * workerCount;
+    size_t emitted = 0;
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::condition_variable advanced;
 
-        std::smatch match;
-        bool matched = false;
-        for (const auto& pattern : options.patterns) {
-            if (matchesPattern(line, match)) {
-                matched = true;
-                break;
+    auto work = [&]() {
+        Worker worker = makeWorker();
+        size_t index;
+        std::string file;
+        while (queue.pop(index, file)) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                advanced.wait(lock, [&]() { return index < emitted + window; });
             }
+
+            // Files still queued after a -q hit are only marked done
+            FileScan scan = makeScan(file, worker, false);
+            if (!cancelled) searchInFile(scan);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            results[index] = {std::move(scan.output), std::move(scan.errors), scan.matchCount, scan.leadingBreak};
+            finished.notify_one();
         }
 
-        if (options.invertMatch) matched = !matched;
+        collect(worker);
+        std::lock_guard<std::mutex> lock(mutex);
+        --running;
+        finished.notify_one();
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < workerCount; ++t) threads.emplace_back(work);
+
+    // Print in queue order so the output matches a serial run byte for byte.
+    // Indices are handed out consecutively, so a gap after the workers have
+    // exited means everything has been printed.
+    for (size_t i = 0;; ++i) {
+        Result ready;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&]() { return results.count(i) > 0 || running == 0; });
+            auto it = results.find(i);
+            if (it == results.end()) break;
+            ready = std::move(it->second);
+            results.erase(it);
+            emitted = i + 1;
+        }
+        advanced.notify_all();
+        GREP_STAT(uint64_t started = timing ? Stats::now() : 0);
+        writeOutput(ready.errors, ready.output, ready.leadingBreak);
+        GREP_STAT(if (timing) printing.printNanos += Stats::now() - started);
+        if (ready.matchCount > 0) anyMatch = true;
+    }
+
+    for (auto& thread : threads) thread.join();
+}
+
+void GrepEngine::searchInFile(FileScan& scan) {
+    std::fill(scan.worker.ring.begin(), scan.worker.ring.end(), LineRef{0, 0, 0});
+    scan.done = options.maxCount == 0;
+    GREP_STAT(++scan.worker.stats.files);
 
-        if (matched) {
-            hasMatch = true;
-            matchCount++;
-            printContext(lineNumber, filename);
-            printMatch(filename, line, lineNumber, match);
-        } else if (!options.onlyFilenames) {
-            buffer[lineNumber % buffer.size()] = ""; // Clear buffer for non-matches if not -l
+    GREP_STAT(uint64_t started = timing ? Stats::now() : 0);
+    MappedFile mapped;
+    bool isMapped = scan.standardInput ? mapped.openDescriptor(STDIN_FILENO) : mapped.open(scan.filename);
+    GREP_STAT(if (timing) scan.worker.stats.readNanos += Stats::now() - started);
+    if (isMapped) {
+        DecompressingSource::Format format;
+        TrigramIndex index;
+        bool binary = options.recursive && mapped.size() > 0 &&
+                      std::memchr(mapped.data(), '\0', std::min(mapped.size(), kBinarySniff));
+
+        // Only the serial loop splits files; pool workers already keep every core busy.
+        // -l and -m depend on the matches before them, so those files stay serial.
+        bool chunked = options.jobs > 1 && scan.streaming && !options.onlyFilenames && options.maxCount < 0 &&
+                       mapped.size() >= 2 * kChunkSize;
+
+        if (DecompressingSource::detect(mapped.data(), mapped.size(), format)) {
+            DecompressingSource source(format, mapped.data(), mapped.size());
+            scanSource(source, scan);
+        } else if (binary) {
+            return;
+        } else if (useIndex && !scan.standardInput && index.open(scan.filename)) {
+            scanIndexed(mapped.data(), mapped.size(), index, scan);
+        } else if (chunked) {
+            scanMappedChunks(mapped.data(), mapped.size(), scan);
+        } else {
+            scanMapped(mapped.data(), mapped.size(), scan);
         }
+    } else {
+        // Pipes, FIFOs, terminals and character devices cannot be mapped
+        int fd = scan.standardInput ? STDIN_FILENO : ::open(scan.filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            scan.errors += "Could not open file: " + scan.filename + "\n";
+            return;
+        }
+        DescriptorSource source(fd);
+        scanSource(source, scan);
+        if (!scan.standardInput) ::close(fd);
     }
 
+    if (options.quiet) return;
     if (options.showCount) {
-        if (!options.noFilename && !options.onlyFilenames) std::cout << filename << ":";
-        std::cout << matchCount << std::endl;
-    } else if (options.onlyFilenames && hasMatch) {
-        std::cout << filename << std::endl;
+        if (!options.noFilename && !options.onlyFilenames) scan.output += scan.filename + ":";
+        appendNumber(scan.output, scan.matchCount);
+        scan.output += '\n';
+    } else if (options.onlyFilenames && scan.matchCount > 0) {
+        scan.output += scan.filename + "\n";
     }
+}
 
-    infile.close();
+void GrepEngine::scanMapped(const char* data, size_t size, FileScan& scan) {
+    scan.base = data;
+    GREP_STAT(scan.worker.stats.bytesRead += size);
+    long lineNumber = 0;
+    scanLines(data, data + size, lineNumber, scan);
 }
 
-bool GrepEngine::matchesPattern(const std::string& line, std::smatch& match) {
-    std::regex_constants::syntax_option_type flags = std::regex::ECMAScript;
-    if (options.ignoreCase) flags |= std::regex::icase;
-    if (options.extendRegex) flags |= std::regex::extended; 
+void GrepEngine::scanIndexed(const char* data, size_t size, const TrigramIndex& index, FileScan& scan) {
+    std::vector<char> candidates;
+    index.candidates(indexQuery, candidates);
+    bool any = std::find(candidates.begin(), candidates.end(), 1) != candidates.end();
+    if (!any) return;
 
-    std::string pattern = options.pattern;
-    if (options.wordMatchOnly) pattern = "\\b" + pattern + "\\b";
+    // Context lines may sit in blocks the index rules out, so only whole files are skipped
+    if (showContext) {
+        scanMapped(data, size, scan);
+        return;
+    }
 
-    try {
-        std::regex re(pattern, flags);
-        return std::regex_search(line, match, re);
-    } catch (const std::regex_error& e) {
-        std::cerr << "Regex error: " << e.what() << std::endl;
-        return false;
+    scan.base = data;
+    size_t count = index.blockCount();
+    for (size_t first = 0; first < count && !scan.done;) {
+        if (!candidates[first]) {
+            ++first;
+            continue;
+        }
+        size_t last = first;
+        while (last + 1 < count && candidates[last + 1]) ++last;
+
+        long lineNumber = index.linesBefore(first);
+        GREP_STAT(scan.worker.stats.bytesRead += index.blockEnd(last) - index.blockBegin(first));
+        scanLines(data + index.blockBegin(first), data + index.blockEnd(last), lineNumber, scan);
+        first = last + 1;
     }
 }
 
-void GrepEngine::printMatch(const std::string& filename, const std::string& line, int lineNumber, const std::smatch& match) {
-    if (!options.noFilename && !options.onlyFilenames) std::cout << filename << ":";
-    if (options.lineNumbers) std::cout << lineNumber << ":";
+void GrepEngine::scanMappedChunks(const char* data, size_t size, FileScan& scan) {
+    std::vector<size_t> bounds{0};
+    while (bounds.back() < size) {
+        size_t next = bounds.back() + kChunkSize;
+        if (next >= size) {
+            next = size;
+        } else {
+            const void* newline = std::memchr(data + next, '\n', size - next);
+            next = newline ? static_cast<const char*>(newline) - data + 1 : size;
+        }
+        bounds.push_back(next);
+    }
+    size_t chunkCount = bounds.size() - 1;
+    GREP_STAT(scan.worker.stats.bytesRead += size);
+    size_t threadCount = std::min<size_t>(options.jobs, chunkCount);
+
+    // Absolute line numbers come from a prefix sum over per-chunk newline counts.
+    // Without -n the numbers only index the context ring, so any base will do.
+    std::vector<long> firstLine(chunkCount, 1);
+    if (options.lineNumbers) {
+        std::vector<long> newlines(chunkCount);
+        std::atomic<size_t> nextChunk{0};
+        auto count = [&]() {
+            for (size_t k = nextChunk++; k < chunkCount; k = nextChunk++) {
+                newlines[k] = ByteScan::countNewlines(data + bounds[k], data + bounds[k + 1]);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < threadCount; ++t) threads.emplace_back(count);
+        for (auto& thread : threads) thread.join();
+
+        for (size_t k = 1; k < chunkCount; ++k) firstLine[k] = firstLine[k - 1] + newlines[k - 1];
+    }
+
+    struct Result {
+        std::string output;
+        long matchCount = 0;
+        bool leadingBreak = false;
+        bool done = false;
+    };
+
+    // Workers may run at most this many chunks ahead of the printer
+    const size_t window = 2 * threadCount;
+    std::vector<Result> results(chunkCount);
+    size_t nextChunk = 0;
+    size_t emitted = 0;
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::condition_variable advanced;
+
+    auto work = [&]() {
+        Worker worker = makeWorker();
+        while (true) {
+            size_t k;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                advanced.wait(lock, [&]() { return nextChunk >= chunkCount || nextChunk < emitted + window; });
+                if (nextChunk >= chunkCount) break;
+                k = nextChunk++;
+            }
+
+            FileScan chunkScan{scan.filename, worker, false, {}, {}, 0, false};
+            if (!cancelled) scanChunk(data, bounds[k], bounds[k + 1], firstLine[k], chunkScan);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            results[k].output = std::move(chunkScan.output);
+            results[k].matchCount = chunkScan.matchCount;
+            results[k].leadingBreak = chunkScan.leadingBreak;
+            results[k].done = true;
+            finished.notify_one();
+        }
+        collect(worker);
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t) threads.emplace_back(work);
+
+    for (size_t k = 0; k < chunkCount; ++k) {
+        Result ready;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&]() { return results[k].done; });
+            ready = std::move(results[k]);
+            emitted = k + 1;
+        }
+        advanced.notify_all();
+
+        // Every chunk is flushed as it arrives, so a break owed by this chunk
+        // depends only on whether anything at all has been written yet
+        scan.matchCount += ready.matchCount;
+        scan.output += ready.output;
+        scan.leadingBreak = ready.leadingBreak;
+        GREP_STAT(uint64_t started = timing ? Stats::now() : 0);
+        flushOutput(scan);
+        GREP_STAT(if (timing) scan.worker.stats.printNanos += Stats::now() - started);
+    }
+
+    for (auto& thread : threads) thread.join();
+}
+
+void GrepEngine::scanChunk(const char* data, size_t begin, size_t end, long firstLine, FileScan& scan) {
+    std::fill(scan.worker.ring.begin(), scan.worker.ring.end(), LineRef{0, 0, 0});
+    scan.base = data;
+
+    // Replay the lines just before the chunk without printing anything, so the
+    // context ring, the -A countdown and the last printed line match a serial scan
+    const long lead = options.beforeContext + options.afterContext + 1;
+    size_t warmStart = begin;
+    long warmLines = 0;
+    while (warmStart > 0 && warmLines < lead) {
+        size_t pos = warmStart - 1;
+        while (pos > 0 && data[pos - 1] != '\n') --pos;
+        warmStart = pos;
+        ++warmLines;
+    }
+
+    long lineNumber = options.lineNumbers ? firstLine - 1 - warmLines : 0;
+    scan.silent = true;
+    scanLines(data + warmStart, data + begin, lineNumber, scan);
+    scan.silent = false;
+    scanLines(data + begin, data + end, lineNumber, scan);
+}
+
+void GrepEngine::scanLines(const char* pos, const char* end, long& lineNumber, FileScan& scan) {
+    // Printing happens inside this loop too; its time is booked separately
+    GREP_STAT(Stats& stats = scan.worker.stats);
+    GREP_STAT(uint64_t started = timing ? Stats::now() : 0, printed = stats.printNanos);
+    if (countOnly) {
+        countLines(pos, end, lineNumber, scan);
+        pos = end;
+    }
+    SkipState skip;
+    while (pos < end && !scan.done && !cancelled.load(std::memory_order_relaxed)) {
+        if (skipLines) {
+            const char* next = nextCandidateLine(pos, end, skip);
+            const char* stop = next ? next : end;
+            // Lines stepped over still count as scanned. Where nothing else
+            // needs their number, only --stats pays for counting them.
+            GREP_STAT(long unterminated = stop > pos && stop[-1] != '\n');
+            if (printSkipped) {
+                GREP_STAT(long before = lineNumber);
+                printRun(pos, stop, lineNumber, scan);
+                GREP_STAT(stats.linesScanned += lineNumber - before);
+            } else if (options.lineNumbers) {
+                long skipped = ByteScan::countNewlines(pos, stop);
+                lineNumber += skipped;
+                GREP_STAT(stats.linesScanned += skipped + unterminated);
+            } else {
+                GREP_STAT(if (timing) stats.linesScanned += ByteScan::countNewlines(pos, stop) + unterminated);
+            }
+            if (!next) break;
+            pos = next;
+        }
+        GREP_STAT(++stats.linesScanned);
+        const char* newline = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+        const char* lineEnd = newline ? newline : end;
+        processLine(std::string_view(pos, lineEnd - pos), ++lineNumber, scan);
+        pos = newline ? newline + 1 : end;
+    }
+    GREP_STAT(if (timing) stats.matchNanos += Stats::now() - started - (stats.printNanos - printed));
+}
+
+const char* GrepEngine::nextCandidateLine(const char* pos, const char* end, SkipState& skip) const {
+    if (pos < skip.pausedUntil) return pos;
+
+    size_t hit = matcher.nextCandidate(std::string_view(pos, end - pos));
+    if (hit == std::string_view::npos) return nullptr;
+    const char* line = pos + hit;
+    while (line > pos && line[-1] != '\n') --line;
+
+    // When nearly every line holds the literal, looking for it first only
+    // doubles the work, so after a run of such hits lines are taken as they come
+    skip.futile = line == pos ? skip.futile + 1 : 0;
+    if (skip.futile == kFutileSkips) {
+        skip.futile = 0;
+        skip.pausedUntil = line + std::min<size_t>(kSkipPause, end - line);
+    }
+    return line;
+}
+
+void GrepEngine::printRun(const char* pos, const char* end, long& lineNumber, FileScan& scan) {
+    if (pos == end) return;
+    bool unterminated = end[-1] != '\n';
+    long lines = ByteScan::countNewlines(pos, end) + unterminated;
+    if (scan.silent) {
+        lineNumber += lines;
+        return;
+    }
+    scan.matchCount += lines;
+    GREP_STAT(scan.worker.stats.matches += lines);
+
+    GREP_STAT(uint64_t started = timing ? Stats::now() : 0);
+    if (options.noFilename && !options.lineNumbers) {
+        // Nothing goes in front of the lines, so the whole stretch is copied as it is
+        lineNumber += lines;
+        std::string_view block(pos, end - pos);
+        if (scan.streaming && block.size() >= kFlushThreshold) {
+            flushOutput(scan);
+            writeOutput(scan.errors, block, false);
+        } else {
+            scan.output.append(block);
+        }
+        if (unterminated) scan.output += '\n';
+    } else {
+        while (pos < end) {
+            const char* newline = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+            const char* lineEnd = newline ? newline : end;
+            printPrefix(scan, ++lineNumber, ':');
+            scan.output.append(pos, lineEnd - pos);
+            scan.output += '\n';
+            pos = newline ? newline + 1 : end;
+        }
+    }
+    if (scan.streaming && (flushEachLine || scan.output.size() >= kFlushThreshold)) flushOutput(scan);
+    GREP_STAT(if (timing) scan.worker.stats.printNanos += Stats::now() - started);
+}
+
+void GrepEngine::countLines(const char* pos, const char* end, long& lineNumber, FileScan& scan) {
+    // A final line without a newline is a line too
+    bool unterminated = pos < end && end[-1] != '\n';
+    if (scan.silent) {
+        lineNumber += ByteScan::countNewlines(pos, end) + unterminated;
+        return;
+    }
+
+    // For -v, skipped stretches are counted in bulk and every other line as it is matched
+    bool needLines = options.invertMatch;
+    long lines = 0;
+    long matched = 0;
+    MatchSpan match{0, 0};
+    SkipState skip;
+    while (pos < end && !cancelled.load(std::memory_order_relaxed)) {
+        if (matcher.canSkip()) {
+            const char* next = nextCandidateLine(pos, end, skip);
+            const char* stop = next ? next : end;
+            long trailing = next ? 0 : unterminated;
+            if (needLines) {
+                lines += ByteScan::countNewlines(pos, stop) + trailing;
+            } else {
+                // Only --stats wants the lines stepped over counted
+                GREP_STAT(if (timing) scan.worker.stats.linesScanned += ByteScan::countNewlines(pos, stop) + trailing);
+            }
+            if (!next) break;
+            pos = next;
+        }
+        ++lines;
+        GREP_STAT(if (!needLines) ++scan.worker.stats.linesScanned);
+        const char* newline = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+        const char* lineEnd = newline ? newline : end;
+        if (matcher.find(std::string_view(pos, lineEnd - pos), match, scan.worker.scratch)) ++matched;
+        pos = newline ? newline + 1 : end;
+    }
+
+    lineNumber += lines;
+    GREP_STAT(if (needLines) scan.worker.stats.linesScanned += lines);
+    long selected = options.invertMatch ? lines - matched : matched;
+    scan.matchCount += selected;
+    GREP_STAT(scan.worker.stats.matches += selected);
+}
+
+void GrepEngine::scanSource(InputSource& source, FileScan& scan) {
+    auto& buffer = scan.worker.readBuffer;
+    if (buffer.size() < 2 * kReadBlock) buffer.resize(2 * kReadBlock);
+
+    size_t filled = 0;
+    size_t lineStart = 0;
+    long lineNumber = 0;
+    scan.baseOffset = 0;
+
+    while (true) {
+        if (buffer.size() - filled < kReadBlock) {
+            // Drop consumed bytes, except lines -B may still need to print
+            size_t keep = lineStart;
+            if (showContext) {
+                for (const auto& held : scan.worker.ring) {
+                    if (held.number > 0 && held.number > lineNumber - options.beforeContext &&
+                        held.number > scan.lastPrinted) {
+                        keep = std::min(keep, held.offset - scan.baseOffset);
+                    }
+                }
+            }
+            std::memmove(buffer.data(), buffer.data() + keep, filled - keep);
+            filled -= keep;
+            lineStart -= keep;
+            scan.baseOffset += keep;
+            if (buffer.size() - filled < kReadBlock) buffer.resize(2 * buffer.size());
+        }
+
+        if (scan.done || cancelled) return;
+        GREP_STAT(uint64_t started = timing ? Stats::now() : 0);
+        long count = source.read(buffer.data() + filled, buffer.size() - filled);
+        GREP_STAT(if (timing) scan.worker.stats.readNanos += Stats::now() - started);
+        if (count < 0) {
+            scan.errors += "Could not read file: " + scan.filename + ": " + source.error() + "\n";
+            break;
+        }
+        if (count == 0) break;
+        filled += count;
+        GREP_STAT(scan.worker.stats.bytesRead += count);
+
+        scan.base = buffer.data();
+        const char* begin = buffer.data() + lineStart;
+        const char* end = buffer.data() + filled;
+        const char* last = end;
+        while (last > begin && last[-1] != '\n') --last;
+        if (last > begin) {
+            scanLines(begin, last, lineNumber, scan);
+            lineStart = last - buffer.data();
+        }
+    }
+
+    // A final line without a trailing newline
+    scan.base = buffer.data();
+    if (lineStart < filled) scanLines(buffer.data() + lineStart, buffer.data() + filled, lineNumber, scan);
+}
+
+void GrepEngine::processLine(std::string_view line, long lineNumber, FileScan& scan) {
+    if (scan.limitReached) {
+        // Past -m only the trailing context of the last match is still owed
+        holdContext(scan, line, lineNumber);
+        if (scan.afterLeft == 0) scan.done = true;
+        return;
+    }
+
+    MatchSpan match{0, 0};
+    bool matched = matcher.find(line, match, scan.worker.scratch);
+
+    if (options.invertMatch) matched = !matched;
+
+    if (!matched) {
+        if (showContext) holdContext(scan, line, lineNumber);
+        return;
+    }
+
+    if (showContext) {
+        printBeforeContext(scan, lineNumber);
+        scan.lastPrinted = lineNumber;
+        scan.afterLeft = options.afterContext;
+    }
+    if (scan.silent) return;
+    scan.matchCount++;
+    GREP_STAT(++scan.worker.stats.matches);
+
+    if (options.quiet) {
+        cancelled = true;
+        scan.done = true;
+        return;
+    }
+    if (options.onlyFilenames) scan.done = true;
+    if (scan.matchCount == options.maxCount) {
+        scan.limitReached = true;
+        scan.done = scan.afterLeft == 0 || !showContext;
+    }
+    if (!printLines) return;
+
+    GREP_STAT(uint64_t started = timing ? Stats::now() : 0);
+    printMatch(scan, line, lineNumber, match);
+    if (scan.streaming && (flushEachLine || scan.output.size() >= kFlushThreshold)) flushOutput(scan);
+    GREP_STAT(if (timing) scan.worker.stats.printNanos += Stats::now() - started);
+}
+
+void GrepEngine::holdContext(FileScan& scan, std::string_view line, long lineNumber) {
+    if (scan.afterLeft > 0) {
+        --scan.afterLeft;
+        scan.lastPrinted = lineNumber;
+        if (scan.silent) return;
+        printPrefix(scan, lineNumber, '-');
+        scan.output.append(line);
+        scan.output += '\n';
+        return;
+    }
+
+    if (options.beforeContext > 0) {
+        auto& ring = scan.worker.ring;
+        size_t offset = scan.baseOffset + (line.data() - scan.base);
+        ring[lineNumber % ring.size()] = LineRef{lineNumber, offset, line.size()};
+    }
+}
+
+void GrepEngine::printBeforeContext(FileScan& scan, long lineNumber) {
+    const auto& ring = scan.worker.ring;
+    long first = std::max(scan.lastPrinted + 1, lineNumber - static_cast<long>(options.beforeContext));
+    // Lines before the start of this scan were never held
+    while (first < lineNumber && ring[first % ring.size()].number != first) ++first;
+
+    if (scan.silent) return;
+    if (scan.lastPrinted == 0) {
+        // Whether a separator is owed depends on output from earlier files or chunks
+        scan.leadingBreak = true;
+    } else if (first > scan.lastPrinted + 1) {
+        scan.output += "--\n";
+    }
+
+    for (long i = first; i < lineNumber; ++i) {
+        const LineRef& held = ring[i % ring.size()];
+        printPrefix(scan, i, '-');
+        scan.output.append(scan.base + (held.offset - scan.baseOffset), held.length);
+        scan.output += '\n';
+    }
+}
+
+void GrepEngine::printPrefix(FileScan& scan, long lineNumber, char separator) {
+    std::string& out = scan.output;
+    if (!options.noFilename && !options.onlyFilenames) {
+        out += scan.filename;
+        out += separator;
+    }
+    if (options.lineNumbers) {
+        appendNumber(out, lineNumber);
+        out += separator;
+    }
+}
+
+void GrepEngine::printMatch(FileScan& scan, std::string_view line, long lineNumber, const MatchSpan& match) {
+    std::string& out = scan.output;
+    printPrefix(scan, lineNumber, ':');
     if (options.onlyMatching) {
-        std::cout << match[0] << std::endl;
+        out.append(line.substr(match.begin, match.end - match.begin));
     } else {
-        std::cout << line << std::endl;
+        out.append(line);
     }
+    out += '\n';
+}
+
+void GrepEngine::flushOutput(FileScan& scan) {
+    writeOutput(scan.errors, scan.output, scan.leadingBreak);
+    scan.errors.clear();
+    scan.output.clear();
+    scan.leadingBreak = false;
 }
 
-void GrepEngine::printContext(int lineNumber, const std::string& filename) {
-    int start = lineNumber - options.beforeContext - 1;
-    int end = lineNumber + options.afterContext - 1;
-    for (int i = start; i <= end; ++i) {
-        if (i < 0 || i >= lineNumber || buffer[i % buffer.size()].empty()) continue;
-        if (!options.noFilename) std::cout << filename << ":";
-        if (options.lineNumbers) std::cout << (i + 1) << ":";
-        std::cout << buffer[i % buffer.size()] << std::endl;
+void GrepEngine::writeOutput(const std::string& errors, std::string_view output, bool leadingBreak) {
+    if (!errors.empty()) {
+        // Keep diagnostics in step with the output that preceded them
+        sink.flush();
+        std::cerr << errors;
     }
+    // Context groups from different files or chunks are separated like any others
+    if (leadingBreak && printedAny) sink.write("--\n");
+    sink.write(output);
+    GREP_STAT(printing.outputBytes += output.size() + (leadingBreak && printedAny ? 3 : 0));
+    if (!output.empty()) printedAny = true;
+    if (flushEachLine) sink.flush();
 }
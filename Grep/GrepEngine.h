@@ -1,24 +1,122 @@
 #ifndef GREPENGINE_H
 #define GREPENGINE_H
 
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <regex>
 #include "GrepOptions.h"
+#include "InputSource.h"
+#include "Matcher.h"
+#include "OutputSink.h"
+#include "PathQueue.h"
+#include "Stats.h"
+#include "TrigramIndex.h"
 
 class GrepEngine {
 public:
     GrepEngine(const GrepOptions& options);
-    void searchFiles(const std::vector<std::string>& files);
+
+    // Returns true if any line was selected in any file
+    bool searchFiles(const std::vector<std::string>& files);
+
+    // Counters and timers of every thread that has finished, for --stats
+    Stats stats() const;
 
 private:
+    // A line held back for -B, stored as a byte offset into the input so it
+    // survives the read buffer being compacted or grown
+    struct LineRef {
+        long number;
+        size_t offset;
+        size_t length;
+    };
+
+    // Whether jumping ahead to candidate lines is paying off in one buffer
+    struct SkipState {
+        int futile = 0;
+        const char* pausedUntil = nullptr;
+    };
+
+    // Scratch state owned by one thread and reused for every file it searches
+    struct Worker {
+        std::vector<LineRef> ring;
+        std::vector<char> readBuffer;
+        Matcher::Scratch scratch;
+        Stats stats;
+    };
+
+    // Everything produced while searching a single file
+    struct FileScan {
+        const std::string& filename;
+        Worker& worker;
+        bool streaming;
+        std::string output;
+        std::string errors;
+        long matchCount;
+        bool silent;
+        // The bytes currently being scanned start at input offset baseOffset
+        const char* base = nullptr;
+        size_t baseOffset = 0;
+        long lastPrinted = 0;
+        long afterLeft = 0;
+        bool leadingBreak = false;
+        // filename is then only a label; the data comes from fd 0
+        bool standardInput = false;
+        // Set once nothing more is needed from this file (-l, -q, -m)
+        bool done = false;
+        bool limitReached = false;
+    };
+
     GrepOptions options;
-    std::vector<std::string> buffer;
+    Matcher matcher;
+    OutputSink sink;
+    TrigramIndex::Query indexQuery;
+    bool useIndex;
+    bool showContext;
+    // Lines without a literal the patterns require are stepped over in bulk
+    bool skipLines;
+    bool printSkipped;
+    // -c: lines are counted in bulk and never reach processLine
+    bool countOnly;
+    bool printLines;
+    bool flushEachLine;
+    bool printedAny;
+    bool anyMatch;
+    // Whether --stats was given. Phase timings and the count of lines the
+    // literal skip steps over cost a pass of their own, so they wait for
+    // it; other counters are always kept.
+    bool timing;
+    Stats totals;
+    // Only touched by the printing thread
+    Stats printing;
+    std::mutex statsMutex;
+    // Raised by -q on the first match so every worker stops
+    std::atomic<bool> cancelled;
 
-    void searchInFile(const std::string& filename);
-    void printMatch(const std::string& filename, const std::string& line, int lineNumber, const std::smatch& match);
-    bool matchesPattern(const std::string& line, std::smatch& match);
-    void printContext(int lineNumber, const std::string& filename);
+    Worker makeWorker() const;
+    void collect(Worker& worker);
+    FileScan makeScan(const std::string& file, Worker& worker, bool streaming) const;
+    void searchQueue(PathQueue& queue);
+    void searchQueueParallel(PathQueue& queue);
+    void searchInFile(FileScan& scan);
+    void scanMapped(const char* data, size_t size, FileScan& scan);
+    void scanIndexed(const char* data, size_t size, const TrigramIndex& index, FileScan& scan);
+    void scanMappedChunks(const char* data, size_t size, FileScan& scan);
+    void scanChunk(const char* data, size_t begin, size_t end, long firstLine, FileScan& scan);
+    void scanLines(const char* pos, const char* end, long& lineNumber, FileScan& scan);
+    const char* nextCandidateLine(const char* pos, const char* end, SkipState& skip) const;
+    void printRun(const char* pos, const char* end, long& lineNumber, FileScan& scan);
+    void countLines(const char* pos, const char* end, long& lineNumber, FileScan& scan);
+    void scanSource(InputSource& source, FileScan& scan);
+    void processLine(std::string_view line, long lineNumber, FileScan& scan);
+    void holdContext(FileScan& scan, std::string_view line, long lineNumber);
+    void printBeforeContext(FileScan& scan, long lineNumber);
+    void printPrefix(FileScan& scan, long lineNumber, char separator);
+    void printMatch(FileScan& scan, std::string_view line, long lineNumber, const MatchSpan& match);
+    void flushOutput(FileScan& scan);
+    void writeOutput(const std::string& errors, std::string_view output, bool leadingBreak);
 };
 
 #endif
@@ -6,7 +6,8 @@
 GrepOptions::GrepOptions()
     : ignoreCase(false), invertMatch(false), showCount(false), noFilename(false),
       onlyFilenames(false), lineNumbers(false), extendRegex(false), wordMatchOnly(false),
-      onlyMatching(false), afterContext(0), beforeContext(0), context(0) {}
+      onlyMatching(false), fixedStrings(false), quiet(false), recursive(false), buildIndex(false),
+      lineBuffered(false), stats(false), statsJson(false), afterContext(0), beforeContext(0), context(0), jobs(1), maxCount(-1) {}
 
 void GrepOptions::parseArgs(int argc, char* argv[]) {
     for (int i = 1; i < argc; i++) {
@@ -20,15 +21,26 @@ void GrepOptions::parseArgs(int argc, char* argv[]) {
         else if (arg == "-E") extendRegex = true;
         else if (arg == "-w") wordMatchOnly = true;
         else if (arg == "-o") onlyMatching = true;
+        else if (arg == "-F") fixedStrings = true;
+        else if (arg == "-q") quiet = true;
+        else if (arg == "-r") recursive = true;
+        else if (arg == "--build-index") buildIndex = true;
+        else if (arg == "--line-buffered") lineBuffered = true;
+        else if (arg == "--stats" || arg == "--stats=text") stats = true;
+        else if (arg == "--stats=json") stats = statsJson = true;
+        else if (arg.compare(0, 10, "--include=") == 0) includeGlobs.push_back(arg.substr(10));
+        else if (arg.compare(0, 10, "--exclude=") == 0) excludeGlobs.push_back(arg.substr(10));
         else if (arg == "-A" && i + 1 < argc) afterContext = std::stoi(argv[++i]);
         else if (arg == "-B" && i + 1 < argc) beforeContext = std::stoi(argv[++i]);
         else if (arg == "-C" && i + 1 < argc) {
             context = std::stoi(argv[++i]);
             afterContext = context;
             beforeContext = context;
-        } else if (arg == "-e" && i + 1 < argc) patterns.push_back(argv[++i]);
+        } else if (arg == "-j" && i + 1 < argc) jobs = std::stoi(argv[++i]);
+        else if (arg == "-m" && i + 1 < argc) maxCount = std::stoi(argv[++i]);
+        else if (arg == "-e" && i + 1 < argc) patterns.push_back(argv[++i]);
         else if (arg == "-f" && i + 1 < argc) loadPatternFile(argv[++i]);
-        else if (!arg.empty() && arg[0] != '-') files.push_back(arg);
+        else if (arg == "-" || (!arg.empty() && arg[0] != '-')) files.push_back(arg);
         else std::cerr << "Unknown option: " << arg << std::endl;
     }
 }
@@ -9,6 +9,8 @@ public:
     std::string pattern;
     std::vector<std::string> files;
     std::vector<std::string> patterns;
+    std::vector<std::string> includeGlobs;
+    std::vector<std::string> excludeGlobs;
     bool ignoreCase;
     bool invertMatch;
     bool showCount;
@@ -18,10 +20,19 @@ public:
     bool extendRegex;
     bool wordMatchOnly;
     bool onlyMatching;
+    bool fixedStrings;
+    bool quiet;
+    bool recursive;
+    bool buildIndex;
+    bool lineBuffered;
+    bool stats;
+    bool statsJson;
 
     int afterContext;
     int beforeContext;
     int context;
+    int jobs;
+    int maxCount;
 
     GrepOptions();
 
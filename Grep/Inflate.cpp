@@ -0,0 +1,358 @@
+#include "Inflate.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const size_t kWindow = 32 * 1024;
+const size_t kMaxMatch = 258;
+const unsigned kFastBits = 10;
+
+const uint16_t kLengthBase[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                  31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t kDistanceBase[30] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                                    193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const uint8_t kDistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+const uint8_t kCodeLengthOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+const uint32_t* crcTable() {
+    static const struct Table {
+        uint32_t entries[256];
+        Table() {
+            for (uint32_t n = 0; n < 256; ++n) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                entries[n] = c;
+            }
+        }
+    } table;
+    return table.entries;
+}
+
+uint32_t updateCrc(uint32_t crc, const unsigned char* data, size_t size) {
+    const uint32_t* table = crcTable();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t readLittle32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+}
+
+Inflate::Inflate(size_t blockSize)
+    : blockSize(blockSize), in(nullptr), inEnd(nullptr), bitBuffer(0), bitCount(0), padded(0), outSize(0),
+      emitStart(0), produced(0), crc(0) {
+    out.resize(kWindow + blockSize + kMaxMatch);
+}
+
+bool Inflate::gunzip(const unsigned char* data, size_t size, const Emit& emit) {
+    failure.clear();
+    in = data;
+    inEnd = data + size;
+
+    // Concatenated members decode as one stream; anything else after the
+    // first member is trailing padding and ignored, as gzip does
+    bool first = true;
+    while (first || (inEnd - in >= 2 && in[0] == 0x1f && in[1] == 0x8b)) {
+        if (!member(emit)) return false;
+        first = false;
+    }
+    return true;
+}
+
+bool Inflate::member(const Emit& emit) {
+    if (inEnd - in < 10 || in[0] != 0x1f || in[1] != 0x8b) return fail("not in gzip format");
+    if (in[2] != 8) return fail("unknown compression method");
+    unsigned flags = in[3];
+    if (flags & 0xe0) return fail("reserved header flags set");
+    in += 10;
+
+    if (flags & 4) {
+        if (inEnd - in < 2) return fail("truncated header");
+        size_t extra = in[0] | (in[1] << 8);
+        if (static_cast<size_t>(inEnd - in) < 2 + extra) return fail("truncated header");
+        in += 2 + extra;
+    }
+    for (unsigned flag : {8u, 16u}) {
+        if (!(flags & flag)) continue;
+        const void* nul = std::memchr(in, 0, inEnd - in);
+        if (!nul) return fail("truncated header");
+        in = static_cast<const unsigned char*>(nul) + 1;
+    }
+    if (flags & 2) {
+        if (inEnd - in < 2) return fail("truncated header");
+        in += 2;
+    }
+
+    bitBuffer = 0;
+    bitCount = 0;
+    padded = 0;
+    outSize = 0;
+    emitStart = 0;
+    produced = 0;
+    crc = 0;
+
+    static Huffman fixedLengths, fixedDistances;
+    static const bool fixedBuilt = []() {
+        uint8_t lengths[288];
+        std::memset(lengths, 8, 144);
+        std::memset(lengths + 144, 9, 112);
+        std::memset(lengths + 256, 7, 24);
+        std::memset(lengths + 280, 8, 8);
+        build(fixedLengths, lengths, 288);
+        std::memset(lengths, 5, 30);
+        build(fixedDistances, lengths, 30);
+        return true;
+    }();
+    (void)fixedBuilt;
+
+    Huffman lengths, distances;
+    bool last = false;
+    while (!last) {
+        last = bits(1);
+        unsigned type = bits(2);
+        bool ok;
+        if (type == 0) {
+            ok = stored(emit);
+        } else if (type == 1) {
+            ok = block(fixedLengths, fixedDistances, emit);
+        } else if (type == 2) {
+            ok = dynamicTables(lengths, distances) && block(lengths, distances, emit);
+        } else {
+            ok = fail("invalid block type");
+        }
+        if (ok && truncated()) ok = fail("unexpected end of file");
+        if (!ok) {
+            // Like gzip, hand over whatever decoded cleanly before the damage
+            if (!failure.empty()) flush(emit);
+            return false;
+        }
+    }
+    if (!flush(emit)) return false;
+
+    in = alignToByte();
+    if (inEnd - in < 8) return fail("unexpected end of file");
+    if (readLittle32(in) != crc) return fail("crc error");
+    if (readLittle32(in + 4) != static_cast<uint32_t>(produced)) return fail("length error");
+    in += 8;
+    return true;
+}
+
+bool Inflate::block(const Huffman& lengths, const Huffman& distances, const Emit& emit) {
+    while (true) {
+        if (outSize >= kWindow + blockSize && !flush(emit)) return false;
+
+        int symbol = decode(lengths);
+        if (symbol < 0) return fail("invalid literal/length code");
+        if (symbol < 256) {
+            out[outSize++] = static_cast<unsigned char>(symbol);
+            ++produced;
+            continue;
+        }
+        if (symbol == 256) return true;
+
+        symbol -= 257;
+        if (symbol >= 29) return fail("invalid literal/length code");
+        size_t length = kLengthBase[symbol] + bits(kLengthExtra[symbol]);
+
+        int code = decode(distances);
+        if (code < 0 || code >= 30) return fail("invalid distance code");
+        size_t distance = kDistanceBase[code] + bits(kDistanceExtra[code]);
+        if (distance > produced || distance > outSize) return fail("invalid distance too far back");
+        if (truncated()) return fail("unexpected end of file");
+
+        unsigned char* to = out.data() + outSize;
+        const unsigned char* from = to - distance;
+        if (distance >= length) {
+            std::memcpy(to, from, length);
+        } else {
+            // Overlapping copies repeat the last few bytes
+            for (size_t i = 0; i < length; ++i) to[i] = from[i];
+        }
+        outSize += length;
+        produced += length;
+    }
+}
+
+bool Inflate::stored(const Emit& emit) {
+    in = alignToByte();
+    if (inEnd - in < 4) return fail("unexpected end of file");
+    size_t length = in[0] | (in[1] << 8);
+    size_t complement = in[2] | (in[3] << 8);
+    if (length != (~complement & 0xffff)) return fail("invalid stored block lengths");
+    in += 4;
+    if (static_cast<size_t>(inEnd - in) < length) return fail("unexpected end of file");
+
+    while (length > 0) {
+        if (outSize >= kWindow + blockSize && !flush(emit)) return false;
+        size_t take = std::min(length, kWindow + blockSize - outSize);
+        std::memcpy(out.data() + outSize, in, take);
+        in += take;
+        length -= take;
+        outSize += take;
+        produced += take;
+    }
+    return true;
+}
+
+bool Inflate::dynamicTables(Huffman& lengths, Huffman& distances) {
+    unsigned literalCount = bits(5) + 257;
+    unsigned distanceCount = bits(5) + 1;
+    unsigned codeLengthCount = bits(4) + 4;
+    if (literalCount > 286 || distanceCount > 30) return fail("too many length or distance symbols");
+
+    uint8_t sizes[320] = {};
+    for (unsigned i = 0; i < codeLengthCount; ++i) sizes[kCodeLengthOrder[i]] = bits(3);
+    Huffman codeLengths;
+    if (!build(codeLengths, sizes, 19)) return fail("invalid code lengths set");
+
+    unsigned total = literalCount + distanceCount;
+    for (unsigned i = 0; i < total;) {
+        int symbol = decode(codeLengths);
+        if (symbol < 0) return fail("invalid code lengths set");
+        if (symbol < 16) {
+            sizes[i++] = symbol;
+            continue;
+        }
+
+        uint8_t repeated = 0;
+        unsigned times;
+        if (symbol == 16) {
+            if (i == 0) return fail("invalid bit length repeat");
+            repeated = sizes[i - 1];
+            times = 3 + bits(2);
+        } else if (symbol == 17) {
+            times = 3 + bits(3);
+        } else {
+            times = 11 + bits(7);
+        }
+        if (i + times > total) return fail("invalid bit length repeat");
+        while (times-- > 0) sizes[i++] = repeated;
+    }
+    if (truncated()) return fail("unexpected end of file");
+    if (sizes[256] == 0) return fail("missing end-of-block code");
+
+    if (!build(lengths, sizes, literalCount)) return fail("invalid literal/lengths set");
+    if (!build(distances, sizes + literalCount, distanceCount)) return fail("invalid distances set");
+    return true;
+}
+
+bool Inflate::build(Huffman& code, const uint8_t* lengths, int count) {
+    std::memset(code.count, 0, sizeof(code.count));
+    for (int i = 0; i < count; ++i) code.count[lengths[i]]++;
+
+    // Reject over-subscribed sets; incomplete ones are legal (e.g. one distance code)
+    int left = 1;
+    for (int len = 1; len < 16; ++len) {
+        left = (left << 1) - code.count[len];
+        if (left < 0) return false;
+    }
+
+    uint16_t offsets[16];
+    uint16_t next[16];
+    offsets[1] = 0;
+    for (int len = 1; len < 15; ++len) offsets[len + 1] = offsets[len] + code.count[len];
+    // next[len] holds the first canonical code of each length
+    next[1] = 0;
+    for (int len = 2; len < 16; ++len) next[len] = (next[len - 1] + code.count[len - 1]) << 1;
+
+    code.fast.assign(size_t(1) << kFastBits, 0);
+    for (int symbol = 0; symbol < count; ++symbol) {
+        unsigned len = lengths[symbol];
+        if (len == 0) continue;
+        code.symbol[offsets[len]++] = symbol;
+
+        unsigned canonical = next[len]++;
+        if (len > kFastBits) continue;
+        // The stream stores codes most significant bit first
+        unsigned reversed = 0;
+        for (unsigned b = 0; b < len; ++b) reversed |= ((canonical >> b) & 1) << (len - 1 - b);
+        for (unsigned slot = reversed; slot < code.fast.size(); slot += 1u << len) {
+            code.fast[slot] = static_cast<uint16_t>(symbol << 4 | len);
+        }
+    }
+    return true;
+}
+
+int Inflate::decode(const Huffman& code) {
+    refill();
+    uint16_t entry = code.fast[bitBuffer & ((1u << kFastBits) - 1)];
+    if (entry != 0) {
+        unsigned len = entry & 15;
+        bitBuffer >>= len;
+        bitCount -= len;
+        return entry >> 4;
+    }
+
+    int value = 0, first = 0, index = 0;
+    for (unsigned len = 1; len < 16; ++len) {
+        value |= (bitBuffer >> (len - 1)) & 1;
+        int count = code.count[len];
+        if (value - count < first) {
+            bitBuffer >>= len;
+            bitCount -= len;
+            return code.symbol[index + (value - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        value <<= 1;
+    }
+    return -1;
+}
+
+bool Inflate::flush(const Emit& emit) {
+    if (outSize > emitStart) {
+        crc = updateCrc(crc, out.data() + emitStart, outSize - emitStart);
+        std::string_view decoded(reinterpret_cast<const char*>(out.data()) + emitStart, outSize - emitStart);
+        if (!emit(decoded)) return false;
+    }
+
+    // Keep just the window back-references may still reach
+    if (outSize > kWindow) {
+        std::memmove(out.data(), out.data() + outSize - kWindow, kWindow);
+        outSize = kWindow;
+    }
+    emitStart = outSize;
+    return true;
+}
+
+void Inflate::refill() {
+    while (bitCount <= 56) {
+        if (in < inEnd) {
+            bitBuffer |= static_cast<uint64_t>(*in++) << bitCount;
+        } else {
+            // Zero bytes past the end; truncated() notices if any get used
+            ++padded;
+        }
+        bitCount += 8;
+    }
+}
+
+uint32_t Inflate::bits(unsigned count) {
+    if (count == 0) return 0;
+    if (bitCount < count) refill();
+    uint32_t value = static_cast<uint32_t>(bitBuffer & ((uint64_t(1) << count) - 1));
+    bitBuffer >>= count;
+    bitCount -= count;
+    return value;
+}
+
+const unsigned char* Inflate::alignToByte() {
+    // Whole bytes still buffered go back to the input
+    bitBuffer >>= bitCount % 8;
+    bitCount -= bitCount % 8;
+    const unsigned char* position = padded > bitCount / 8 ? inEnd : in + padded - bitCount / 8;
+    bitBuffer = 0;
+    bitCount = 0;
+    padded = 0;
+    return position;
+}
+
+bool Inflate::fail(const char* message) {
+    failure = message;
+    return false;
+}
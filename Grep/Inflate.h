@@ -0,0 +1,66 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Small gzip/DEFLATE decoder (RFC 1951/1952). The compressed input must be
+// fully in memory (it comes from a mapping); decoded output is handed to a
+// callback in blocks, keeping only the 32 KiB history window between them.
+class Inflate {
+public:
+    // Receives each decoded block; returning false stops decoding
+    using Emit = std::function<bool(std::string_view)>;
+
+    explicit Inflate(size_t blockSize);
+
+    // Decodes every gzip member in the input. Returns false on corrupt or
+    // truncated data (see error()) or when emit asked to stop.
+    bool gunzip(const unsigned char* data, size_t size, const Emit& emit);
+
+    const std::string& error() const { return failure; }
+
+private:
+    // Canonical Huffman code. Codes up to kFastBits long resolve with one
+    // table lookup; longer ones are walked bit by bit from count/symbol.
+    struct Huffman {
+        std::vector<uint16_t> fast;
+        uint16_t count[16];
+        uint16_t symbol[320];
+    };
+
+    size_t blockSize;
+    std::string failure;
+
+    const unsigned char* in;
+    const unsigned char* inEnd;
+    uint64_t bitBuffer;
+    unsigned bitCount;
+    size_t padded;
+
+    std::vector<unsigned char> out;
+    size_t outSize;
+    size_t emitStart;
+    uint64_t produced;
+    uint32_t crc;
+
+    bool member(const Emit& emit);
+    bool block(const Huffman& lengths, const Huffman& distances, const Emit& emit);
+    bool stored(const Emit& emit);
+    bool dynamicTables(Huffman& lengths, Huffman& distances);
+    static bool build(Huffman& code, const uint8_t* lengths, int count);
+    int decode(const Huffman& code);
+    bool flush(const Emit& emit);
+
+    void refill();
+    uint32_t bits(unsigned count);
+    bool truncated() const { return padded * 8 > bitCount; }
+    const unsigned char* alignToByte();
+    bool fail(const char* message);
+};
+
+#endif
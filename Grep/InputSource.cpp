@@ -0,0 +1,127 @@
+#include "InputSource.h"
+#include "Inflate.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#ifdef GREP_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+// Decompressed data is handed over in blocks of this size, at most
+// kQueueDepth of them waiting at a time
+const size_t kBlockSize = 256 * 1024;
+const size_t kQueueDepth = 4;
+
+}
+
+DescriptorSource::DescriptorSource(int fd) : fd(fd) {}
+
+long DescriptorSource::read(char* buffer, size_t size) {
+    while (true) {
+        ssize_t count = ::read(fd, buffer, size);
+        if (count >= 0) return count;
+        if (errno == EINTR) continue;
+        failure = std::strerror(errno);
+        return -1;
+    }
+}
+
+bool DecompressingSource::detect(const char* data, size_t size, Format& format) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    if (size >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b) {
+        format = Format::Gzip;
+        return true;
+    }
+    if (size >= 4 && bytes[0] == 0x28 && bytes[1] == 0xb5 && bytes[2] == 0x2f && bytes[3] == 0xfd) {
+        format = Format::Zstd;
+        return true;
+    }
+    return false;
+}
+
+DecompressingSource::DecompressingSource(Format format, const char* data, size_t size)
+    : currentPos(0), finished(false), abandoned(false) {
+    producer = std::thread([this, format, data, size]() { produce(format, data, size); });
+}
+
+DecompressingSource::~DecompressingSource() {
+    // The reader may stop early (-l, -q, -m); wake the producer so it can quit
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        abandoned = true;
+    }
+    changed.notify_all();
+    producer.join();
+}
+
+long DecompressingSource::read(char* buffer, size_t size) {
+    if (currentPos == current.size()) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]() { return !blocks.empty() || finished; });
+        if (blocks.empty()) {
+            if (producerError.empty()) return 0;
+            failure = producerError;
+            return -1;
+        }
+        current = std::move(blocks.front());
+        blocks.pop_front();
+        currentPos = 0;
+        lock.unlock();
+        changed.notify_all();
+    }
+
+    size_t count = std::min(size, current.size() - currentPos);
+    std::memcpy(buffer, current.data() + currentPos, count);
+    currentPos += count;
+    return static_cast<long>(count);
+}
+
+void DecompressingSource::produce(Format format, const char* data, size_t size) {
+    std::string error;
+    if (format == Format::Gzip) {
+        Inflate inflate(kBlockSize);
+        auto emit = [this](std::string_view block) { return push(block); };
+        if (!inflate.gunzip(reinterpret_cast<const unsigned char*>(data), size, emit)) error = inflate.error();
+    } else {
+#ifdef GREP_HAVE_ZSTD
+        ZSTD_DCtx* context = ZSTD_createDCtx();
+        std::string block(kBlockSize, '\0');
+        ZSTD_inBuffer input{data, size, 0};
+        size_t result = 0;
+        bool more = true;
+        while (more) {
+            ZSTD_outBuffer output{&block[0], block.size(), 0};
+            result = ZSTD_decompressStream(context, &output, &input);
+            if (ZSTD_isError(result)) {
+                error = ZSTD_getErrorName(result);
+                break;
+            }
+            if (output.pos > 0 && !push(std::string_view(block.data(), output.pos))) break;
+            // A full output buffer may mean more data is pending inside the decoder
+            more = input.pos < input.size || output.pos == output.size;
+        }
+        // A non-zero hint after all input was used means the last frame is cut short
+        if (!more && result != 0) error = "unexpected end of file";
+        ZSTD_freeDCtx(context);
+#else
+        error = "zstd support not built in (define GREP_HAVE_ZSTD and link libzstd)";
+#endif
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    producerError = error;
+    finished = true;
+    changed.notify_all();
+}
+
+bool DecompressingSource::push(std::string_view block) {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [&]() { return blocks.size() < kQueueDepth || abandoned; });
+    if (abandoned) return false;
+    blocks.emplace_back(block);
+    changed.notify_all();
+    return true;
+}
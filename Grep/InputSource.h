@@ -0,0 +1,73 @@
+#ifndef INPUTSOURCE_H
+#define INPUTSOURCE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Byte stream that GrepEngine splits into lines when a file cannot be
+// scanned straight out of its mapping.
+class InputSource {
+public:
+    virtual ~InputSource() {}
+
+    // Fills up to size bytes; returns 0 at the end of the input and -1 on error
+    virtual long read(char* buffer, size_t size) = 0;
+
+    // Description of the failure after read() returned -1
+    const std::string& error() const { return failure; }
+
+protected:
+    std::string failure;
+};
+
+// Plain reads from an open descriptor (pipes, FIFOs, devices)
+class DescriptorSource : public InputSource {
+public:
+    explicit DescriptorSource(int fd);
+
+    long read(char* buffer, size_t size) override;
+
+private:
+    int fd;
+};
+
+// Decompresses a mapped .gz or .zst file on a background thread. Fixed-size
+// blocks are passed over through a small bounded queue, so inflating the
+// next block overlaps with matching the current one. zstd needs libzstd and
+// is only available when built with GREP_HAVE_ZSTD.
+class DecompressingSource : public InputSource {
+public:
+    enum class Format { Gzip, Zstd };
+
+    // Recognises a compressed file by its magic bytes
+    static bool detect(const char* data, size_t size, Format& format);
+
+    DecompressingSource(Format format, const char* data, size_t size);
+    ~DecompressingSource() override;
+
+    DecompressingSource(const DecompressingSource&) = delete;
+    DecompressingSource& operator=(const DecompressingSource&) = delete;
+
+    long read(char* buffer, size_t size) override;
+
+private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::string> blocks;
+    std::string current;
+    size_t currentPos;
+    bool finished;
+    bool abandoned;
+    std::string producerError;
+    std::thread producer;
+
+    void produce(Format format, const char* data, size_t size);
+    bool push(std::string_view block);
+};
+
+#endif
@@ -0,0 +1,129 @@
+#include "LiteralSearch.h"
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+unsigned char foldAscii(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+unsigned char upperAscii(unsigned char c) {
+    return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+// Compares n bytes of text, folded to lower case, with an already folded needle
+bool equalsFolded(const char* text, const char* folded, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    // Adding 63 moves 'A'..'Z' to the bottom of the signed range, below -102
+    const __m128i shift = _mm_set1_epi8(63);
+    const __m128i limit = _mm_set1_epi8(-102);
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        __m128i upper = _mm_cmplt_epi8(_mm_add_epi8(bytes, shift), limit);
+        __m128i lower = _mm_or_si128(bytes, _mm_and_si128(upper, caseBit));
+        __m128i want = _mm_loadu_si128(reinterpret_cast<const __m128i*>(folded + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(lower, want)) != 0xffff) return false;
+    }
+#endif
+    for (; i < n; ++i) {
+        if (foldAscii(text[i]) != static_cast<unsigned char>(folded[i])) return false;
+    }
+    return true;
+}
+
+}
+
+LiteralSearch::LiteralSearch()
+    : ignoreCase(false), firstLower(0), firstUpper(0), lastLower(0), lastUpper(0) {}
+
+LiteralSearch::LiteralSearch(const std::string& pattern, bool ignoreCase)
+    : needle(pattern), ignoreCase(ignoreCase), firstLower(0), firstUpper(0), lastLower(0), lastUpper(0) {
+    if (ignoreCase) {
+        for (auto& c : needle) c = foldAscii(c);
+    }
+    if (needle.empty()) return;
+
+    firstLower = needle.front();
+    lastLower = needle.back();
+    firstUpper = ignoreCase ? upperAscii(firstLower) : firstLower;
+    lastUpper = ignoreCase ? upperAscii(lastLower) : lastLower;
+}
+
+bool LiteralSearch::confirm(const char* candidate) const {
+    // First and last bytes were already checked by the filter
+    size_t n = needle.size();
+    if (n <= 2) return true;
+    if (!ignoreCase) return std::memcmp(candidate + 1, needle.data() + 1, n - 2) == 0;
+    return equalsFolded(candidate + 1, needle.data() + 1, n - 2);
+}
+
+size_t LiteralSearch::find(std::string_view text, size_t from) const {
+    size_t n = needle.size();
+    if (n == 0) return from <= text.size() ? from : npos;
+    if (from > text.size() || text.size() - from < n) return npos;
+
+    const char* base = text.data();
+    size_t last = text.size() - n;  // last viable start position
+    size_t pos = from;
+
+    if (!ignoreCase && n == 1) {
+        const void* hit = std::memchr(base + pos, needle[0], text.size() - pos);
+        return hit ? static_cast<const char*>(hit) - base : npos;
+    }
+
+#if defined(__AVX2__)
+    const __m256i firstLo = _mm256_set1_epi8(static_cast<char>(firstLower));
+    const __m256i firstUp = _mm256_set1_epi8(static_cast<char>(firstUpper));
+    const __m256i lastLo = _mm256_set1_epi8(static_cast<char>(lastLower));
+    const __m256i lastUp = _mm256_set1_epi8(static_cast<char>(lastUpper));
+    while (pos + 32 <= last + 1) {
+        __m256i head = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(base + pos));
+        __m256i tail = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(base + pos + n - 1));
+        __m256i headHit = _mm256_or_si256(_mm256_cmpeq_epi8(head, firstLo), _mm256_cmpeq_epi8(head, firstUp));
+        __m256i tailHit = _mm256_or_si256(_mm256_cmpeq_epi8(tail, lastLo), _mm256_cmpeq_epi8(tail, lastUp));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(headHit, tailHit)));
+        while (mask) {
+            size_t offset = __builtin_ctz(mask);
+            if (confirm(base + pos + offset)) return pos + offset;
+            mask &= mask - 1;
+        }
+        pos += 32;
+    }
+#elif defined(__SSE2__)
+    const __m128i firstLo = _mm_set1_epi8(static_cast<char>(firstLower));
+    const __m128i firstUp = _mm_set1_epi8(static_cast<char>(firstUpper));
+    const __m128i lastLo = _mm_set1_epi8(static_cast<char>(lastLower));
+    const __m128i lastUp = _mm_set1_epi8(static_cast<char>(lastUpper));
+    while (pos + 16 <= last + 1) {
+        __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base + pos));
+        __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base + pos + n - 1));
+        __m128i headHit = _mm_or_si128(_mm_cmpeq_epi8(head, firstLo), _mm_cmpeq_epi8(head, firstUp));
+        __m128i tailHit = _mm_or_si128(_mm_cmpeq_epi8(tail, lastLo), _mm_cmpeq_epi8(tail, lastUp));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(headHit, tailHit)));
+        while (mask) {
+            size_t offset = __builtin_ctz(mask);
+            if (confirm(base + pos + offset)) return pos + offset;
+            mask &= mask - 1;
+        }
+        pos += 16;
+    }
+#endif
+
+    for (; pos <= last; ++pos) {
+        unsigned char head = base[pos];
+        unsigned char tail = base[pos + n - 1];
+        if ((head == firstLower || head == firstUpper) && (tail == lastLower || tail == lastUpper) &&
+            confirm(base + pos)) {
+            return pos;
+        }
+    }
+    return npos;
+}
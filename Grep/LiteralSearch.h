@@ -0,0 +1,31 @@
+#ifndef LITERALSEARCH_H
+#define LITERALSEARCH_H
+
+#include <string>
+#include <string_view>
+
+// Substring search for a fixed needle. Candidate positions are found by
+// comparing the needle's first and last bytes against a whole vector of
+// haystack bytes at once; survivors are confirmed with a plain compare.
+// With ignoreCase both filters accept either ASCII case and the compare folds
+// the candidate sixteen bytes at a time.
+class LiteralSearch {
+public:
+    static const size_t npos = std::string::npos;
+
+    LiteralSearch();
+    LiteralSearch(const std::string& needle, bool ignoreCase);
+
+    size_t find(std::string_view text, size_t from = 0) const;
+    size_t size() const { return needle.size(); }
+
+private:
+    std::string needle;
+    bool ignoreCase;
+    unsigned char firstLower, firstUpper;
+    unsigned char lastLower, lastUpper;
+
+    bool confirm(const char* candidate) const;
+};
+
+#endif
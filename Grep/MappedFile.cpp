@@ -0,0 +1,48 @@
+#include "MappedFile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile() : mapped(nullptr), length(0) {}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& filename) {
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    bool opened = openDescriptor(fd);
+    ::close(fd);
+    return opened;
+}
+
+bool MappedFile::openDescriptor(int fd) {
+    close();
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return false;
+    // Part of an inherited descriptor may already have been consumed
+    if (lseek(fd, 0, SEEK_CUR) != 0) return false;
+
+    // mmap rejects zero-length mappings; an empty file is simply no lines
+    if (st.st_size == 0) return true;
+
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) return false;
+
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    mapped = static_cast<const char*>(addr);
+    length = st.st_size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (mapped) munmap(const_cast<char*>(mapped), length);
+    mapped = nullptr;
+    length = 0;
+}
@@ -0,0 +1,31 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a regular file. open() fails for pipes,
+// character devices and anything else that cannot be mapped, so callers
+// can fall back to buffered reads.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& filename);
+    // Maps whatever fd refers to (e.g. stdin redirected from a file); fd stays open
+    bool openDescriptor(int fd);
+    void close();
+
+    const char* data() const { return mapped; }
+    size_t size() const { return length; }
+
+private:
+    const char* mapped;
+    size_t length;
+};
+
+#endif
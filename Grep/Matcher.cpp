@@ -0,0 +1,236 @@
+#include "Matcher.h"
+#include "ByteScan.h"
+#include "Utf8.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// From this many literal patterns on, one automaton pass beats a search per pattern
+const size_t kAutomatonThreshold = 4;
+
+// Characters with a special meaning in ECMAScript or POSIX ERE syntax
+const char* kMetaCharacters = "\\^$.|?*+()[]{}";
+
+// Bytes that are common in logs and prose, roughly most common first.
+// Anything not listed is taken to be rare.
+const char kCommonBytes[] = " etaoinsrhldcumfpgwybvk0123456789:.-=/_,[]()ETAOINSRHLDCUMFPGWYBVK";
+
+int commonness(unsigned char c) {
+    const char* hit = c ? std::strchr(kCommonBytes, c) : nullptr;
+    return hit ? static_cast<int>(sizeof(kCommonBytes) - (hit - kCommonBytes)) : 0;
+}
+
+// Lower is rarer. LiteralSearch filters candidates on the first and last
+// byte, so those decide; length only breaks ties.
+size_t rarityScore(const Regex::Factor& factor) {
+    const std::string& text = factor.text;
+    int common = commonness(text.front()) + commonness(text.back());
+    return static_cast<size_t>(common) * 64 + 63 - std::min<size_t>(text.size(), 63);
+}
+
+// Same rule as regex \b: word-ness differs on either side of pos. ASCII
+// neighbours are settled by their byte; only others get decoded.
+bool isWordBoundary(std::string_view line, size_t pos) {
+    return Utf8::isWordBefore(line, pos) != Utf8::isWordAt(line, pos);
+}
+
+bool isWholeWord(std::string_view line, size_t begin, size_t end) {
+    return isWordBoundary(line, begin) && isWordBoundary(line, end);
+}
+
+// The same text as a pattern for the regex engine
+std::string escapeLiteral(const std::string& literal) {
+    std::string pattern;
+    for (char c : literal) {
+        if (std::strchr(kMetaCharacters, c)) pattern += '\\';
+        pattern += c;
+    }
+    return pattern;
+}
+
+}
+
+Matcher::Matcher(const GrepOptions& options)
+    : cacheCount(0), wordMatchOnly(options.wordMatchOnly), needSpan(options.onlyMatching) {
+    // POSIX grammars have no \b, so -w keeps ECMAScript (which accepts ERE syntax)
+    std::regex_constants::syntax_option_type flags = std::regex::ECMAScript;
+    if (options.extendRegex && !options.wordMatchOnly) flags = std::regex::extended;
+    if (options.ignoreCase) flags |= std::regex::icase;
+    flags |= std::regex::optimize;
+
+    std::vector<std::string> literals;
+    std::vector<std::string> regexSources;
+    for (const auto& source : options.patterns) {
+        std::string literal = source;
+        if (options.fixedStrings || extractLiteral(source, literal)) {
+            // Literal search folds ASCII only; other cases need the regex engine's alternations
+            if (options.ignoreCase && Utf8::hasCaseVariants(literal)) {
+                regexSources.push_back(escapeLiteral(literal));
+                continue;
+            }
+            literals.push_back(literal);
+        } else {
+            regexSources.push_back(source);
+        }
+    }
+
+    for (const auto& literal : literals) {
+        std::string text = literal;
+        if (options.ignoreCase) {
+            for (char& c : text) c = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+        }
+        factors.push_back({{text, options.ignoreCase}});
+    }
+
+    // An empty literal matches every line, so the automaton would gain nothing
+    bool hasEmpty = std::find(literals.begin(), literals.end(), std::string()) != literals.end();
+    if (literals.size() >= kAutomatonThreshold && !hasEmpty) {
+        automaton = std::make_unique<AhoCorasick>(literals, options.ignoreCase);
+    } else {
+        for (const auto& literal : literals) {
+            patterns.emplace_back(Kind::Literal);
+            patterns.back().literal = LiteralSearch(literal, options.ignoreCase);
+        }
+    }
+
+    for (const auto& source : regexSources) {
+        std::string pattern = source;
+        if (options.wordMatchOnly) pattern = "\\b(?:" + pattern + ")\\b";
+
+        try {
+            // -E asks for POSIX leftmost-longest spans
+            auto compiled = std::make_unique<Regex>(pattern, options.ignoreCase, options.extendRegex);
+            factors.push_back(compiled->requiredFactors());
+            patterns.emplace_back(Kind::Compiled);
+            patterns.back().decodeWords = compiled->hasWordAssertions() && Utf8::localeIsUtf8();
+            patterns.back().compiled = std::move(compiled);
+            patterns.back().cache = cacheCount++;
+            if (!factors.back().empty()) {
+                const auto& rarest = *std::min_element(
+                    factors.back().begin(), factors.back().end(),
+                    [](const Regex::Factor& a, const Regex::Factor& b) { return rarityScore(a) < rarityScore(b); });
+                patterns.back().prefilter = LiteralSearch(rarest.text, rarest.ignoreCase);
+                patterns.back().hasPrefilter = true;
+            }
+            continue;
+        } catch (const RegexError& e) {
+            if (!e.isUnsupported()) {
+                std::cerr << "Regex error in '" << source << "': " << e.what() << std::endl;
+                continue;
+            }
+        }
+
+        try {
+            std::regex fallback(pattern, flags);
+            patterns.emplace_back(Kind::Fallback);
+            patterns.back().fallback = std::move(fallback);
+            factors.emplace_back();
+        } catch (const std::regex_error& e) {
+            std::cerr << "Regex error in '" << source << "': " << e.what() << std::endl;
+        }
+    }
+
+    buildGate();
+}
+
+void Matcher::buildGate() {
+    std::vector<std::string> needles;
+    bool ignoreCase = false;
+    for (const auto& alternative : factors) {
+        // An empty literal or a pattern without one can match any line
+        if (alternative.empty() || alternative.front().text.empty()) return;
+        const auto& rarest = *std::min_element(
+            alternative.begin(), alternative.end(),
+            [](const Regex::Factor& a, const Regex::Factor& b) { return rarityScore(a) < rarityScore(b); });
+        needles.push_back(rarest.text);
+        // Folding for one needle only lets the others through more often
+        ignoreCase |= rarest.ignoreCase;
+    }
+
+    if (needles.size() == 1) {
+        gateLiteral = std::make_unique<LiteralSearch>(needles.front(), ignoreCase);
+    } else if (!needles.empty()) {
+        gateAutomaton = std::make_unique<AhoCorasick>(needles, ignoreCase);
+    }
+}
+
+size_t Matcher::nextCandidate(std::string_view text) const {
+    if (gateLiteral) return gateLiteral->find(text);
+    size_t begin, end;
+    return gateAutomaton->find(text, begin, end) ? begin : std::string_view::npos;
+}
+
+Matcher::Scratch Matcher::makeScratch() const {
+    Scratch scratch;
+    scratch.caches.resize(cacheCount);
+    return scratch;
+}
+
+bool Matcher::extractLiteral(const std::string& pattern, std::string& literal) {
+    literal.clear();
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (c == '\\') {
+            // An escaped metacharacter is just that character; \d, \b and friends are not
+            if (i + 1 < pattern.size() && std::strchr(kMetaCharacters, pattern[i + 1])) {
+                literal += pattern[++i];
+                continue;
+            }
+            return false;
+        }
+        if (std::strchr(kMetaCharacters, c)) return false;
+        literal += c;
+    }
+    return true;
+}
+
+bool Matcher::find(std::string_view line, MatchSpan& match, Scratch& scratch) const {
+    if (automaton && automaton->find(line, match.begin, match.end, wordMatchOnly ? isWholeWord : nullptr)) {
+        return true;
+    }
+
+    for (const auto& pattern : patterns) {
+        if (pattern.kind == Kind::Literal) {
+            if (findLiteral(pattern.literal, line, match)) return true;
+            continue;
+        }
+
+        if (pattern.hasPrefilter && pattern.prefilter.find(line) == LiteralSearch::npos) continue;
+        GREP_STAT(++scratch.regexCalls);
+        if (pattern.kind == Kind::Compiled) {
+            Regex::Cache& cache = scratch.caches[pattern.cache];
+            if (pattern.decodeWords && !ByteScan::isAscii(line.data(), line.data() + line.size())) {
+                if (pattern.compiled->find(line, match.begin, match.end, cache, true)) return true;
+            } else if (!needSpan) {
+                if (pattern.compiled->matches(line, cache)) return true;
+            } else if (pattern.compiled->find(line, match.begin, match.end, cache)) {
+                return true;
+            }
+            continue;
+        }
+
+        std::cmatch result;
+        if (std::regex_search(line.data(), line.data() + line.size(), result, pattern.fallback)) {
+            match.begin = result.position(0);
+            match.end = match.begin + result.length(0);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Matcher::findLiteral(const LiteralSearch& literal, std::string_view line, MatchSpan& match) const {
+    size_t pos = literal.find(line);
+    while (pos != LiteralSearch::npos) {
+        size_t end = pos + literal.size();
+        if (!wordMatchOnly || isWholeWord(line, pos, end)) {
+            match.begin = pos;
+            match.end = end;
+            return true;
+        }
+        pos = literal.find(line, pos + 1);
+    }
+    return false;
+}
@@ -0,0 +1,86 @@
+#ifndef MATCHER_H
+#define MATCHER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <regex>
+#include <memory>
+#include "GrepOptions.h"
+#include "LiteralSearch.h"
+#include "AhoCorasick.h"
+#include "Regex.h"
+#include "Stats.h"
+
+// Byte offsets of a match within the line it was found in
+struct MatchSpan {
+    size_t begin;
+    size_t end;
+};
+
+// All -e/-f patterns, compiled once with -i/-w/-E/-F applied. Patterns
+// without regex metacharacters (or every pattern under -F) go through
+// LiteralSearch, or a single Aho-Corasick automaton when there are many of
+// them. Everything else runs on the bundled linear-time Regex engine; only
+// constructs it rejects (backreferences, lookaround) fall back to std::regex.
+class Matcher {
+public:
+    // Mutable per-thread state for the regex engine; one per worker
+    struct Scratch {
+        std::vector<Regex::Cache> caches;
+        GREP_STAT(uint64_t regexCalls = 0;)
+    };
+
+    explicit Matcher(const GrepOptions& options);
+
+    Scratch makeScratch() const;
+
+    // Finds the first pattern that matches the line, in pattern order. Literals
+    // merged into the automaton are tried first and report the leftmost match.
+    // The span is only filled in for -o; otherwise it is left empty.
+    bool find(std::string_view line, MatchSpan& match, Scratch& scratch) const;
+
+    // For each pattern, literals that every line it matches must contain.
+    // An empty entry means the pattern can match without any fixed text.
+    const std::vector<std::vector<Regex::Factor>>& requiredFactors() const { return factors; }
+
+    // True when every pattern requires some literal, so text without any of
+    // them (one per pattern, the rarest) can be skipped without matching it
+    bool canSkip() const { return gateLiteral || gateAutomaton; }
+
+    // Offset of the first of those literals in text, or npos
+    size_t nextCandidate(std::string_view text) const;
+
+private:
+    enum class Kind { Literal, Compiled, Fallback };
+
+    struct Pattern {
+        explicit Pattern(Kind kind) : kind(kind) {}
+
+        Kind kind;
+        LiteralSearch literal;
+        std::unique_ptr<Regex> compiled;
+        std::regex fallback;
+        size_t cache = 0;
+        // A literal every match contains; lines without it skip the regex
+        LiteralSearch prefilter;
+        bool hasPrefilter = false;
+        // \b or \B in a UTF-8 locale: lines that are not ASCII decode characters
+        bool decodeWords = false;
+    };
+
+    std::vector<Pattern> patterns;
+    std::unique_ptr<AhoCorasick> automaton;
+    std::vector<std::vector<Regex::Factor>> factors;
+    std::unique_ptr<LiteralSearch> gateLiteral;
+    std::unique_ptr<AhoCorasick> gateAutomaton;
+    size_t cacheCount;
+    bool wordMatchOnly;
+    bool needSpan;
+
+    static bool extractLiteral(const std::string& pattern, std::string& literal);
+    void buildGate();
+    bool findLiteral(const LiteralSearch& literal, std::string_view line, MatchSpan& match) const;
+};
+
+#endif
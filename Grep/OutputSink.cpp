@@ -0,0 +1,46 @@
+#include "OutputSink.h"
+#include <cerrno>
+#include <unistd.h>
+
+namespace {
+
+const size_t kBufferSize = 256 * 1024;
+
+}
+
+OutputSink::OutputSink(int fd) : fd(fd), tty(isatty(fd) != 0), failed(false) {
+    buffer.reserve(kBufferSize);
+}
+
+OutputSink::~OutputSink() {
+    flush();
+}
+
+void OutputSink::write(std::string_view block) {
+    if (buffer.size() + block.size() > kBufferSize) {
+        flush();
+        if (block.size() >= kBufferSize) {
+            writeAll(block.data(), block.size());
+            return;
+        }
+    }
+    buffer.append(block);
+}
+
+void OutputSink::flush() {
+    writeAll(buffer.data(), buffer.size());
+    buffer.clear();
+}
+
+void OutputSink::writeAll(const char* data, size_t size) {
+    // After a failed write (a closed pipe, a full disk) the rest is dropped
+    while (size > 0 && !failed) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno != EINTR) failed = true;
+            continue;
+        }
+        data += written;
+        size -= written;
+    }
+}
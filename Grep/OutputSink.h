@@ -0,0 +1,35 @@
+#ifndef OUTPUTSINK_H
+#define OUTPUTSINK_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Buffered writer for a file descriptor. Output is collected in one large
+// user-space buffer and handed to the kernel with a single write(2) when
+// it fills up, on flush() or on destruction. Blocks larger than the buffer
+// bypass it. Not thread-safe; only the printing thread may use it.
+class OutputSink {
+public:
+    explicit OutputSink(int fd);
+    ~OutputSink();
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    void write(std::string_view block);
+    void flush();
+
+    // True when the descriptor is a terminal and output should not be held back
+    bool interactive() const { return tty; }
+
+private:
+    int fd;
+    bool tty;
+    bool failed;
+    std::string buffer;
+
+    void writeAll(const char* data, size_t size);
+};
+
+#endif
@@ -0,0 +1,30 @@
+#include "PathQueue.h"
+
+PathQueue::PathQueue() : nextIndex(0), closed(false) {}
+
+void PathQueue::push(std::string path) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(std::move(path));
+    }
+    available.notify_one();
+}
+
+void PathQueue::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+    }
+    available.notify_all();
+}
+
+bool PathQueue::pop(size_t& index, std::string& path) {
+    std::unique_lock<std::mutex> lock(mutex);
+    available.wait(lock, [&]() { return closed || !pending.empty(); });
+    if (pending.empty()) return false;
+
+    path = std::move(pending.front());
+    pending.pop_front();
+    index = nextIndex++;
+    return true;
+}
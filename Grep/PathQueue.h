@@ -0,0 +1,30 @@
+#ifndef PATHQUEUE_H
+#define PATHQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+
+// Files waiting to be searched. Each path is numbered in the order it was
+// pushed so results can be printed in that order. Producers push until
+// close(); consumers pop until the queue is closed and drained.
+class PathQueue {
+public:
+    PathQueue();
+
+    void push(std::string path);
+    void close();
+
+    // Blocks until a path is available; false once the queue is closed and empty
+    bool pop(size_t& index, std::string& path);
+
+private:
+    std::mutex mutex;
+    std::condition_variable available;
+    std::deque<std::string> pending;
+    size_t nextIndex;
+    bool closed;
+};
+
+#endif
@@ -0,0 +1,1063 @@
+#include "Regex.h"
+#include "Utf8.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace {
+
+const int32_t kUnknown = -1;
+const int32_t kMatched = -2;
+const int32_t kDead = -3;
+
+// Beyond these the DFA cache is flushed and the program considered too large
+const size_t kMaxDfaStates = 4096;
+const size_t kMaxProgramSize = 100000;
+const int kMaxRepeat = 1000;
+
+const int32_t kFlagPrevWord = 1;
+const int32_t kFlagAtStart = 2;
+
+bool isWordByte(int c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+std::bitset<256> wordSet() {
+    std::bitset<256> set;
+    for (int c = 0; c < 256; ++c) {
+        if (isWordByte(c)) set.set(c);
+    }
+    return set;
+}
+
+}
+
+// Recursive-descent parser that builds an AST and compiles it into the
+// owning Regex's instruction list and byte sets
+class RegexParser {
+public:
+    RegexParser(Regex& regex, const std::string& pattern, bool ignoreCase)
+        : regex(regex), pattern(pattern), ignoreCase(ignoreCase), pos(0) {}
+
+    void run() {
+        Node root = parseAlternation();
+        if (pos < pattern.size()) fail("unmatched )");
+
+        Literals literals = literalsOf(root);
+        regex.factors = std::move(literals.required);
+        if (literals.exact) addFactor(regex.factors, literals.text, literals.folded);
+
+        compile(root);
+        emit(Regex::Match, 0, 0);
+        regex.start = 0;
+    }
+
+private:
+    struct Node {
+        enum Kind { Empty, Set, Concat, Alternate, Repeat, Assert } kind;
+        int32_t set;
+        Regex::Op assertion;
+        int min, max;  // max < 0 means unbounded
+        bool greedy;
+        std::vector<Node> children;
+    };
+
+    // Literal content of a subtree: the single string it matches, if it
+    // matches exactly one, and strings that every match of it contains
+    struct Literals {
+        bool exact;
+        std::string text;
+        bool folded;
+        std::vector<Regex::Factor> required;
+    };
+
+    // Closed ranges of code points above 0x7f named in a bracket expression
+    using CodeRanges = std::vector<std::pair<char32_t, char32_t>>;
+
+    Regex& regex;
+    const std::string& pattern;
+    bool ignoreCase;
+    size_t pos;
+
+    [[noreturn]] void fail(const std::string& message) const {
+        throw RegexError(message + " at offset " + std::to_string(pos), false);
+    }
+
+    [[noreturn]] void unsupported(const std::string& feature) const {
+        throw RegexError(feature + " is not supported", true);
+    }
+
+    bool atEnd() const { return pos >= pattern.size(); }
+    char peek() const { return pattern[pos]; }
+
+    static Node makeNode(Node::Kind kind) {
+        Node node;
+        node.kind = kind;
+        node.set = -1;
+        node.assertion = Regex::Match;
+        node.min = node.max = 0;
+        node.greedy = true;
+        return node;
+    }
+
+    void foldCase(std::bitset<256>& set) const {
+        if (!ignoreCase) return;
+        for (int c = 'a'; c <= 'z'; ++c) {
+            if (set.test(c) || set.test(c - 'a' + 'A')) {
+                set.set(c);
+                set.set(c - 'a' + 'A');
+            }
+        }
+    }
+
+    Node setNode(std::bitset<256> set) {
+        foldCase(set);
+        Node node = makeNode(Node::Set);
+        node.set = regex.sets.size();
+        regex.sets.push_back(set);
+        return node;
+    }
+
+    // For sets defined by what they leave out ('.', [^...], \W and the
+    // like). In a UTF-8 locale, taking every byte above 0x7f means taking
+    // every multibyte character, so one match consumes a whole character
+    // and stray bytes that start none are not matched.
+    Node complementNode(std::bitset<256> set) {
+        if (!Utf8::localeIsUtf8()) return setNode(set);
+        for (int c = 0x80; c < 0x100; ++c) {
+            if (!set.test(c)) return setNode(set);
+        }
+        for (int c = 0x80; c < 0x100; ++c) set.reset(c);
+
+        Node alternate = makeNode(Node::Alternate);
+        alternate.children.push_back(setNode(set));
+        // Lead bytes of two, three and four byte sequences
+        const int leads[][2] = {{0xc2, 0xdf}, {0xe0, 0xef}, {0xf0, 0xf4}};
+        for (int length = 2; length <= 4; ++length) {
+            Node sequence = makeNode(Node::Concat);
+            std::bitset<256> lead;
+            for (int c = leads[length - 2][0]; c <= leads[length - 2][1]; ++c) lead.set(c);
+            sequence.children.push_back(setNode(lead));
+            std::bitset<256> continuation;
+            for (int c = 0x80; c < 0xc0; ++c) continuation.set(c);
+            for (int i = 1; i < length; ++i) sequence.children.push_back(setNode(continuation));
+            alternate.children.push_back(sequence);
+        }
+        return alternate;
+    }
+
+    Node assertNode(Regex::Op op) {
+        Node node = makeNode(Node::Assert);
+        node.assertion = op;
+        return node;
+    }
+
+    Node parseAlternation() {
+        std::vector<Node> branches;
+        branches.push_back(parseConcat());
+        while (!atEnd() && peek() == '|') {
+            ++pos;
+            branches.push_back(parseConcat());
+        }
+        if (branches.size() == 1) return branches.front();
+        Node node = makeNode(Node::Alternate);
+        node.children = std::move(branches);
+        return node;
+    }
+
+    Node parseConcat() {
+        Node node = makeNode(Node::Concat);
+        while (!atEnd() && peek() != '|' && peek() != ')') {
+            node.children.push_back(parseRepeat());
+        }
+        if (node.children.empty()) return makeNode(Node::Empty);
+        if (node.children.size() == 1) return node.children.front();
+        return node;
+    }
+
+    // Parses {n}, {n,} or {n,m} at pos; leaves pos untouched if it is not one
+    bool parseInterval(int& min, int& max) {
+        size_t save = pos;
+        auto number = [&](int& value) {
+            size_t begin = pos;
+            value = 0;
+            while (!atEnd() && std::isdigit(static_cast<unsigned char>(peek()))) {
+                value = value * 10 + (peek() - '0');
+                if (value > kMaxRepeat) unsupported("repeat count above " + std::to_string(kMaxRepeat));
+                ++pos;
+            }
+            return pos > begin;
+        };
+
+        ++pos;
+        if (!number(min)) {
+            pos = save;
+            return false;
+        }
+        max = min;
+        if (!atEnd() && peek() == ',') {
+            ++pos;
+            if (!number(max)) max = -1;
+        }
+        if (atEnd() || peek() != '}') {
+            pos = save;
+            return false;
+        }
+        ++pos;
+        if (max >= 0 && max < min) fail("invalid repeat range");
+        return true;
+    }
+
+    Node parseRepeat() {
+        Node atom = parseAtom();
+        while (!atEnd()) {
+            int min, max;
+            char c = peek();
+            if (c == '*') {
+                min = 0, max = -1;
+                ++pos;
+            } else if (c == '+') {
+                min = 1, max = -1;
+                ++pos;
+            } else if (c == '?') {
+                min = 0, max = 1;
+                ++pos;
+            } else if (c == '{' && parseInterval(min, max)) {
+            } else {
+                break;
+            }
+
+            Node repeat = makeNode(Node::Repeat);
+            repeat.min = min;
+            repeat.max = max;
+            if (!atEnd() && peek() == '?') {
+                repeat.greedy = false;
+                ++pos;
+            }
+            repeat.children.push_back(std::move(atom));
+            atom = std::move(repeat);
+        }
+        return atom;
+    }
+
+    Node parseAtom() {
+        char c = peek();
+        switch (c) {
+            case '(': {
+                ++pos;
+                if (!atEnd() && peek() == '?') {
+                    if (pos + 1 < pattern.size() && pattern[pos + 1] == ':') {
+                        pos += 2;
+                    } else {
+                        unsupported("lookaround and named groups");
+                    }
+                }
+                Node inner = parseAlternation();
+                if (atEnd() || peek() != ')') fail("missing )");
+                ++pos;
+                return inner;
+            }
+            case '[':
+                return parseClass();
+            case '.': {
+                ++pos;
+                std::bitset<256> any;
+                any.set();
+                any.reset('\n');
+                return complementNode(any);
+            }
+            case '^':
+                ++pos;
+                return assertNode(Regex::AssertBol);
+            case '$':
+                ++pos;
+                return assertNode(Regex::AssertEol);
+            case '\\':
+                return parseEscape();
+            case '*':
+            case '+':
+            case '?':
+                fail("nothing to repeat");
+            case '{': {
+                int min, max;
+                if (parseInterval(min, max)) fail("nothing to repeat");
+                break;
+            }
+        }
+
+        if (Utf8::sequenceLength(std::string_view(pattern).substr(pos)) > 0) return characterNode();
+
+        ++pos;
+        std::bitset<256> single;
+        single.set(static_cast<unsigned char>(c));
+        return setNode(single);
+    }
+
+    // A multibyte character, kept whole so repeats apply to all of it. Under
+    // ignoreCase it becomes an alternation of the cases the locale knows.
+    Node characterNode() {
+        size_t length = Utf8::sequenceLength(std::string_view(pattern).substr(pos));
+        std::vector<std::string> variants{pattern.substr(pos, length)};
+        if (ignoreCase) variants = Utf8::caseVariants(variants.front());
+        pos += length;
+
+        Node alternate = makeNode(Node::Alternate);
+        for (const auto& variant : variants) {
+            Node bytes = makeNode(Node::Concat);
+            for (char b : variant) {
+                std::bitset<256> single;
+                single.set(static_cast<unsigned char>(b));
+                bytes.children.push_back(setNode(single));
+            }
+            alternate.children.push_back(bytes.children.size() == 1 ? bytes.children.front() : bytes);
+        }
+        return alternate.children.size() == 1 ? alternate.children.front() : alternate;
+    }
+
+    // \d, \w, \s and their negations; false if c names no class
+    static bool classEscape(char c, std::bitset<256>& set) {
+        std::bitset<256> members;
+        switch (std::tolower(static_cast<unsigned char>(c))) {
+            case 'd':
+                for (int b = '0'; b <= '9'; ++b) members.set(b);
+                break;
+            case 'w':
+                members = wordSet();
+                break;
+            case 's':
+                for (char b : std::string(" \t\n\r\f\v")) members.set(static_cast<unsigned char>(b));
+                break;
+            default:
+                return false;
+        }
+        if (std::isupper(static_cast<unsigned char>(c))) members.flip();
+        set |= members;
+        return true;
+    }
+
+    // Single-byte escapes shared by classes and atoms; -1 if c is not one
+    int controlEscape(char c) {
+        switch (c) {
+            case 'n': return '\n';
+            case 't': return '\t';
+            case 'r': return '\r';
+            case 'f': return '\f';
+            case 'v': return '\v';
+            case '0': return 0;
+            case 'x': {
+                if (pos + 2 > pattern.size() || !std::isxdigit(static_cast<unsigned char>(pattern[pos])) ||
+                    !std::isxdigit(static_cast<unsigned char>(pattern[pos + 1]))) {
+                    fail("invalid \\x escape");
+                }
+                int value = std::stoi(pattern.substr(pos, 2), nullptr, 16);
+                pos += 2;
+                return value;
+            }
+        }
+        return -1;
+    }
+
+    Node parseEscape() {
+        ++pos;
+        if (atEnd()) fail("trailing backslash");
+        char c = pattern[pos++];
+
+        if (c == 'b') return assertNode(Regex::AssertWord);
+        if (c == 'B') return assertNode(Regex::AssertNotWord);
+        if (c >= '1' && c <= '9') unsupported("backreferences");
+
+        std::bitset<256> set;
+        if (classEscape(c, set)) return complementNode(set);
+
+        int control = controlEscape(c);
+        set.set(static_cast<unsigned char>(control >= 0 ? control : c));
+        return setNode(set);
+    }
+
+    bool namedClass(const std::string& name, std::bitset<256>& set) const {
+        int (*test)(int) = nullptr;
+        if (name == "alpha") test = isalpha;
+        else if (name == "digit") test = isdigit;
+        else if (name == "alnum") test = isalnum;
+        else if (name == "upper") test = isupper;
+        else if (name == "lower") test = islower;
+        else if (name == "space") test = isspace;
+        else if (name == "punct") test = ispunct;
+        else if (name == "xdigit") test = isxdigit;
+        else if (name == "blank") test = isblank;
+        else if (name == "cntrl") test = iscntrl;
+        else if (name == "graph") test = isgraph;
+        else if (name == "print") test = isprint;
+        else if (name == "word") {
+            set |= wordSet();
+            return true;
+        } else {
+            return false;
+        }
+        for (int c = 0; c < 128; ++c) {
+            if (test(c)) set.set(c);
+        }
+        return true;
+    }
+
+    Node parseClass() {
+        ++pos;
+        bool negate = false;
+        if (!atEnd() && peek() == '^') {
+            negate = true;
+            ++pos;
+        }
+
+        std::bitset<256> set;
+        CodeRanges characters;
+        bool first = true;
+        while (true) {
+            if (atEnd()) fail("unterminated [");
+            char c = peek();
+            if (c == ']' && !first) {
+                ++pos;
+                break;
+            }
+            first = false;
+
+            if (c == '[' && pos + 1 < pattern.size() && pattern[pos + 1] == ':') {
+                size_t close = pattern.find(":]", pos + 2);
+                if (close == std::string::npos) fail("unterminated [:");
+                if (!namedClass(pattern.substr(pos + 2, close - pos - 2), set)) fail("unknown character class");
+                pos = close + 2;
+                continue;
+            }
+            if (c == '[' && pos + 1 < pattern.size() && (pattern[pos + 1] == '.' || pattern[pos + 1] == '=')) {
+                unsupported("collating elements");
+            }
+
+            int low;
+            bool lowCharacter;
+            if (!classMember(set, low, lowCharacter)) continue;
+            if (pos + 1 < pattern.size() && peek() == '-' && pattern[pos + 1] != ']') {
+                ++pos;
+                int high;
+                bool highCharacter;
+                if (!classMember(set, high, highCharacter)) fail("invalid range");
+                if (high < low) fail("invalid range");
+                if (!lowCharacter && !highCharacter) {
+                    for (int b = low; b <= high; ++b) set.set(b);
+                } else if (lowCharacter && highCharacter) {
+                    characters.emplace_back(low, high);
+                } else if (!lowCharacter && low < 0x80) {
+                    // From ASCII up into multibyte characters, as in [a-é]
+                    for (int b = low; b < 0x80; ++b) set.set(b);
+                    characters.emplace_back(0x80, high);
+                } else {
+                    unsupported("ranges between a byte and a multibyte character");
+                }
+            } else if (lowCharacter) {
+                characters.emplace_back(low, low);
+            } else {
+                set.set(low);
+            }
+        }
+
+        if (!characters.empty()) return characterClass(set, std::move(characters), negate);
+        if (!negate) return setNode(set);
+        // Case folding has to happen before the complement
+        foldCase(set);
+        set.flip();
+        set.reset('\n');
+        return complementNode(set);
+    }
+
+    // Reads one class member into value; class escapes are merged into set
+    // directly and return false since they cannot start a range. In a UTF-8
+    // locale a multibyte character is one member, and character is set with
+    // value holding its code point rather than a byte.
+    bool classMember(std::bitset<256>& set, int& value, bool& character) {
+        character = false;
+        if (Utf8::localeIsUtf8() && static_cast<unsigned char>(peek()) >= 0x80) {
+            std::string_view rest = std::string_view(pattern).substr(pos);
+            if (size_t length = Utf8::sequenceLength(rest)) {
+                value = Utf8::decode(rest);
+                character = true;
+                pos += length;
+                return true;
+            }
+        }
+
+        char c = pattern[pos++];
+        if (c != '\\') {
+            value = static_cast<unsigned char>(c);
+            return true;
+        }
+        if (atEnd()) fail("trailing backslash");
+        c = pattern[pos++];
+        if (classEscape(c, set)) return false;
+        if (c == 'b') {
+            value = '\b';
+            return true;
+        }
+        int control = controlEscape(c);
+        value = control >= 0 ? control : static_cast<unsigned char>(c);
+        return true;
+    }
+
+    // A bracket expression with multibyte members. It becomes an alternation
+    // of the ASCII members and the byte sequences encoding the code points,
+    // so a match consumes whole characters, never a lone lead byte.
+    Node characterClass(std::bitset<256> set, CodeRanges characters, bool negate) {
+        foldCase(set);
+        if (ignoreCase) {
+            CodeRanges variants;
+            for (const auto& [low, high] : characters) {
+                for (char32_t c = low; c <= high; ++c) {
+                    if (c >= 0xd800 && c <= 0xdfff) continue;
+                    for (const auto& variant : Utf8::caseVariants(Utf8::encode(c))) {
+                        char32_t folded = Utf8::decode(variant);
+                        if (variant.size() == 1) {
+                            set.set(static_cast<unsigned char>(variant[0]));
+                        } else if (folded != c) {
+                            variants.emplace_back(folded, folded);
+                        }
+                    }
+                }
+            }
+            characters.insert(characters.end(), variants.begin(), variants.end());
+        }
+
+        std::sort(characters.begin(), characters.end());
+        CodeRanges merged;
+        for (const auto& range : characters) {
+            if (!merged.empty() && range.first <= merged.back().second + 1) {
+                merged.back().second = std::max(merged.back().second, range.second);
+            } else {
+                merged.push_back(range);
+            }
+        }
+
+        std::bitset<256> ascii;
+        if (negate) {
+            // Every character but the members and newline; stray bytes above
+            // 0x7f never match a negated class, as with complementNode
+            for (int c = 0; c < 0x80; ++c) ascii.set(c, !set.test(c));
+            ascii.reset('\n');
+            CodeRanges rest;
+            char32_t next = 0x80;
+            for (const auto& [low, high] : merged) {
+                if (low > next) rest.emplace_back(next, low - 1);
+                next = high + 1;
+            }
+            if (next <= 0x10ffff) rest.emplace_back(next, 0x10ffff);
+            merged.swap(rest);
+        } else {
+            ascii = set;
+        }
+
+        Node alternate = makeNode(Node::Alternate);
+        if (ascii.any()) alternate.children.push_back(setNode(ascii));
+        for (const auto& [low, high] : merged) appendSequences(low, high, alternate);
+        if (alternate.children.empty()) return setNode(ascii);
+        return alternate.children.size() == 1 ? alternate.children.front() : alternate;
+    }
+
+    // Adds the byte sequences encoding exactly the code points low..high
+    // (all above 0x7f) to alternate, one per run of characters that share
+    // their leading bytes and take every value in the rest
+    void appendSequences(char32_t low, char32_t high, Node& alternate) {
+        if (low > high) return;
+        if (low <= 0xdfff && high >= 0xd800) {
+            // Surrogates are not characters
+            if (low < 0xd800) appendSequences(low, 0xd7ff, alternate);
+            if (high > 0xdfff) appendSequences(0xe000, high, alternate);
+            return;
+        }
+        for (char32_t limit : {char32_t(0x7ff), char32_t(0xffff)}) {
+            if (low <= limit && high > limit) {
+                appendSequences(low, limit, alternate);
+                appendSequences(limit + 1, high, alternate);
+                return;
+            }
+        }
+        for (int continuations = 1; continuations < 4; ++continuations) {
+            char32_t mask = (char32_t(1) << (6 * continuations)) - 1;
+            if ((low & ~mask) == (high & ~mask)) continue;
+            if ((low & mask) != 0) {
+                appendSequences(low, low | mask, alternate);
+                appendSequences((low | mask) + 1, high, alternate);
+                return;
+            }
+            if ((high & mask) != mask) {
+                appendSequences(low, (high & ~mask) - 1, alternate);
+                appendSequences(high & ~mask, high, alternate);
+                return;
+            }
+        }
+
+        std::string first = Utf8::encode(low);
+        std::string last = Utf8::encode(high);
+        Node sequence = makeNode(Node::Concat);
+        for (size_t i = 0; i < first.size(); ++i) {
+            std::bitset<256> bytes;
+            for (int b = static_cast<unsigned char>(first[i]); b <= static_cast<unsigned char>(last[i]); ++b) {
+                bytes.set(b);
+            }
+            sequence.children.push_back(setNode(bytes));
+        }
+        alternate.children.push_back(sequence);
+    }
+
+    int32_t emit(Regex::Op op, int32_t x, int32_t y) {
+        if (regex.program.size() >= kMaxProgramSize) unsupported("patterns this large");
+        regex.program.push_back({op, x, y});
+        return regex.program.size() - 1;
+    }
+
+    int32_t here() const { return regex.program.size(); }
+
+    // A set that stands for one byte, or for both cases of one letter
+    static bool singleByte(const std::bitset<256>& set, char& c, bool& folded) {
+        size_t count = set.count();
+        if (count == 0 || count > 2) return false;
+        int first = 0;
+        while (!set.test(first)) ++first;
+        c = static_cast<char>(first);
+        folded = count == 2;
+        return !folded || (first >= 'A' && first <= 'Z' && set.test(first - 'A' + 'a'));
+    }
+
+    static void addFactor(std::vector<Regex::Factor>& factors, std::string text, bool folded) {
+        if (text.empty()) return;
+        if (folded) {
+            for (char& c : text) c = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+        }
+        factors.push_back({std::move(text), folded});
+    }
+
+    Literals literalsOf(const Node& node) const {
+        Literals result{false, std::string(), false, {}};
+        switch (node.kind) {
+            case Node::Empty:
+            case Node::Assert:
+                result.exact = true;
+                break;
+            case Node::Set: {
+                char c;
+                if (singleByte(regex.sets[node.set], c, result.folded)) {
+                    result.exact = true;
+                    result.text = c;
+                }
+                break;
+            }
+            case Node::Concat:
+                // Runs of exact children join up into one longer factor
+                result.exact = true;
+                for (const auto& child : node.children) {
+                    Literals part = literalsOf(child);
+                    if (part.exact) {
+                        result.text += part.text;
+                        result.folded |= part.folded;
+                        continue;
+                    }
+                    addFactor(result.required, result.text, result.folded);
+                    result.text.clear();
+                    result.folded = false;
+                    result.exact = false;
+                    for (auto& factor : part.required) result.required.push_back(std::move(factor));
+                }
+                if (!result.exact) addFactor(result.required, result.text, result.folded);
+                break;
+            case Node::Alternate:
+                break;
+            case Node::Repeat: {
+                if (node.min == 0) break;
+                Literals body = literalsOf(node.children.front());
+                if (body.exact && node.max == node.min) {
+                    result.exact = true;
+                    result.folded = body.folded;
+                    for (int i = 0; i < node.min; ++i) result.text += body.text;
+                    break;
+                }
+                result.required = std::move(body.required);
+                if (body.exact) addFactor(result.required, body.text, body.folded);
+                break;
+            }
+        }
+        return result;
+    }
+
+    void compile(const Node& node) {
+        switch (node.kind) {
+            case Node::Empty:
+                break;
+            case Node::Set:
+                emit(Regex::ByteSet, node.set, 0);
+                break;
+            case Node::Assert:
+                emit(node.assertion, 0, 0);
+                break;
+            case Node::Concat:
+                for (const auto& child : node.children) compile(child);
+                break;
+            case Node::Alternate: {
+                std::vector<int32_t> exits;
+                for (size_t i = 0; i + 1 < node.children.size(); ++i) {
+                    int32_t split = emit(Regex::Split, here() + 1, 0);
+                    compile(node.children[i]);
+                    exits.push_back(emit(Regex::Jump, 0, 0));
+                    regex.program[split].y = here();
+                }
+                compile(node.children.back());
+                for (int32_t exit : exits) regex.program[exit].x = here();
+                break;
+            }
+            case Node::Repeat: {
+                const Node& body = node.children.front();
+                for (int i = 0; i < node.min; ++i) compile(body);
+
+                if (node.max < 0) {
+                    int32_t loop = emit(Regex::Split, 0, 0);
+                    compile(body);
+                    emit(Regex::Jump, loop, 0);
+                    setBranches(loop, loop + 1, here(), node.greedy);
+                    break;
+                }
+
+                std::vector<int32_t> skips;
+                for (int i = node.min; i < node.max; ++i) {
+                    skips.push_back(emit(Regex::Split, 0, 0));
+                    compile(body);
+                }
+                for (int32_t skip : skips) setBranches(skip, skip + 1, here(), node.greedy);
+                break;
+            }
+        }
+    }
+
+    void setBranches(int32_t split, int32_t body, int32_t out, bool greedy) {
+        regex.program[split].x = greedy ? body : out;
+        regex.program[split].y = greedy ? out : body;
+    }
+};
+
+Regex::Cache::Cache() : generation(0) {}
+
+Regex::Regex(const std::string& pattern, bool ignoreCase, bool longest)
+    : start(0), longest(longest), restartable(true), wordAssertions(false) {
+    RegexParser(*this, pattern, ignoreCase).run();
+    buildByteClasses();
+
+    for (const auto& inst : program) {
+        if (inst.op == AssertWord || inst.op == AssertNotWord) wordAssertions = true;
+    }
+
+    // Without a path from the start that avoids ^, nothing can match after
+    // the first byte, and the DFA may give up as soon as its threads die
+    std::vector<bool> seen(program.size(), false);
+    std::vector<int32_t> stack{start};
+    restartable = false;
+    while (!stack.empty() && !restartable) {
+        int32_t pc = stack.back();
+        stack.pop_back();
+        if (seen[pc]) continue;
+        seen[pc] = true;
+        const Inst& inst = program[pc];
+        switch (inst.op) {
+            case ByteSet:
+            case Match:
+                restartable = true;
+                break;
+            case Split:
+                stack.push_back(inst.y);
+                stack.push_back(inst.x);
+                break;
+            case Jump:
+                stack.push_back(inst.x);
+                break;
+            case AssertBol:
+                break;
+            default:
+                stack.push_back(pc + 1);
+                break;
+        }
+    }
+}
+
+void Regex::buildByteClasses() {
+    // Bytes no set (or \b) can tell apart share a DFA column
+    std::vector<std::bitset<256>> splits = sets;
+    splits.push_back(wordSet());
+
+    std::memset(classOf, 0, sizeof(classOf));
+    int classCount = 1;
+    for (const auto& split : splits) {
+        int remap[256][2];
+        for (auto& entry : remap) entry[0] = entry[1] = -1;
+        int next = 0;
+        for (int c = 0; c < 256; ++c) {
+            int& slot = remap[classOf[c]][split.test(c)];
+            if (slot < 0) slot = next++;
+            classOf[c] = slot;
+        }
+        classCount = next;
+    }
+
+    classByte.assign(classCount, 0);
+    for (int c = 255; c >= 0; --c) classByte[classOf[c]] = c;
+}
+
+bool Regex::assertionHolds(Op op, const Position& at) const {
+    switch (op) {
+        case AssertBol: return at.atStart;
+        case AssertEol: return at.atEnd;
+        case AssertWord: return at.prevWord != at.nextWord;
+        case AssertNotWord: return at.prevWord == at.nextWord;
+        default: return false;
+    }
+}
+
+bool Regex::follow(const std::vector<int32_t>& from, bool withStart, const Position& at,
+                   Cache& cache, std::vector<int32_t>& consumers) const {
+    consumers.clear();
+    if (++cache.generation == 0) {
+        std::fill(cache.marks.begin(), cache.marks.end(), 0);
+        cache.generation = 1;
+    }
+
+    auto& stack = cache.stack;
+    stack.assign(from.begin(), from.end());
+    if (withStart) stack.push_back(start);
+
+    bool matched = false;
+    while (!stack.empty()) {
+        int32_t pc = stack.back();
+        stack.pop_back();
+        if (cache.marks[pc] == cache.generation) continue;
+        cache.marks[pc] = cache.generation;
+
+        const Inst& inst = program[pc];
+        switch (inst.op) {
+            case ByteSet:
+                consumers.push_back(pc);
+                break;
+            case Match:
+                matched = true;
+                break;
+            case Split:
+                stack.push_back(inst.y);
+                stack.push_back(inst.x);
+                break;
+            case Jump:
+                stack.push_back(inst.x);
+                break;
+            default:
+                if (assertionHolds(inst.op, at)) stack.push_back(pc + 1);
+                break;
+        }
+    }
+    return matched;
+}
+
+void Regex::prepare(Cache& cache) const {
+    if (cache.marks.size() == program.size() && !cache.keys.empty()) return;
+
+    cache.marks.assign(program.size(), 0);
+    cache.generation = 0;
+    cache.table.clear();
+    cache.endMatch.clear();
+    cache.keys.clear();
+    cache.ids.clear();
+
+    // State 0 is the start of a line: no threads yet, ^ still possible
+    std::vector<int32_t> initial{kFlagAtStart};
+    addState(cache, initial);
+}
+
+// A DFA state is the sorted set of NFA pcs waiting right after a consumed
+// byte, followed by one word of flags for the assertions
+int32_t Regex::addState(Cache& cache, std::vector<int32_t>& key) const {
+    auto it = cache.ids.find(key);
+    if (it != cache.ids.end()) return it->second;
+
+    int32_t id = cache.keys.size();
+    cache.ids.emplace(key, id);
+    cache.keys.push_back(key);
+    cache.table.resize(cache.table.size() + classByte.size(), kUnknown);
+    cache.endMatch.push_back(-1);
+    return id;
+}
+
+int32_t Regex::transition(Cache& cache, int32_t state, uint8_t byteClass) const {
+    std::vector<int32_t> key = cache.keys[state];
+
+    if (cache.keys.size() >= kMaxDfaStates) {
+        // Flush the cache but keep the line-start state at id 0 and the state we are in
+        cache.table.clear();
+        cache.endMatch.clear();
+        cache.keys.clear();
+        cache.ids.clear();
+        std::vector<int32_t> initial{kFlagAtStart};
+        addState(cache, initial);
+        state = addState(cache, key);
+    }
+
+    int32_t flags = key.back();
+    key.pop_back();
+    int c = classByte[byteClass];
+
+    Position at{(flags & kFlagAtStart) != 0, (flags & kFlagPrevWord) != 0, isWordByte(c), false};
+    int32_t result;
+    if (follow(key, true, at, cache, cache.closure)) {
+        result = kMatched;
+    } else {
+        std::vector<int32_t> next;
+        for (int32_t pc : cache.closure) {
+            if (sets[program[pc].x].test(c)) next.push_back(pc + 1);
+        }
+        std::sort(next.begin(), next.end());
+        next.erase(std::unique(next.begin(), next.end()), next.end());
+
+        if (next.empty() && !restartable) {
+            result = kDead;
+        } else {
+            next.push_back(wordAssertions && isWordByte(c) ? kFlagPrevWord : 0);
+            result = addState(cache, next);
+        }
+    }
+
+    cache.table[state * classByte.size() + byteClass] = result;
+    return result;
+}
+
+bool Regex::matchesAtEnd(Cache& cache, int32_t state) const {
+    int8_t& known = cache.endMatch[state];
+    if (known < 0) {
+        std::vector<int32_t> key = cache.keys[state];
+        int32_t flags = key.back();
+        key.pop_back();
+        Position at{(flags & kFlagAtStart) != 0, (flags & kFlagPrevWord) != 0, false, true};
+        known = follow(key, true, at, cache, cache.closure) ? 1 : 0;
+    }
+    return known == 1;
+}
+
+bool Regex::matches(std::string_view text, Cache& cache) const {
+    prepare(cache);
+    const size_t classCount = classByte.size();
+    const unsigned char* pos = reinterpret_cast<const unsigned char*>(text.data());
+    const unsigned char* end = pos + text.size();
+
+    int32_t state = 0;
+    for (; pos < end; ++pos) {
+        uint8_t byteClass = classOf[*pos];
+        int32_t next = cache.table[state * classCount + byteClass];
+        if (next < 0) {
+            if (next == kUnknown) next = transition(cache, state, byteClass);
+            if (next == kMatched) return true;
+            if (next == kDead) return false;
+        }
+        state = next;
+    }
+    return matchesAtEnd(cache, state);
+}
+
+void Regex::addThread(Cache& cache, std::vector<std::pair<int32_t, size_t>>& list, int32_t pc, size_t begin,
+                      std::string_view text, size_t pos, bool decodeWords) const {
+    Position at{pos == 0, false, false, pos == text.size()};
+    if (decodeWords) {
+        at.prevWord = Utf8::isWordBefore(text, pos);
+        at.nextWord = Utf8::isWordAt(text, pos);
+    } else {
+        at.prevWord = pos > 0 && isWordByte(static_cast<unsigned char>(text[pos - 1]));
+        at.nextWord = pos < text.size() && isWordByte(static_cast<unsigned char>(text[pos]));
+    }
+
+    // Depth-first with the first Split branch explored first, so list order is priority order
+    auto& stack = cache.stack;
+    stack.assign(1, pc);
+    while (!stack.empty()) {
+        int32_t current = stack.back();
+        stack.pop_back();
+        if (cache.marks[current] == cache.generation) continue;
+        cache.marks[current] = cache.generation;
+
+        const Inst& inst = program[current];
+        switch (inst.op) {
+            case ByteSet:
+            case Match:
+                list.emplace_back(current, begin);
+                break;
+            case Split:
+                stack.push_back(inst.y);
+                stack.push_back(inst.x);
+                break;
+            case Jump:
+                stack.push_back(inst.x);
+                break;
+            default:
+                if (assertionHolds(inst.op, at)) stack.push_back(current + 1);
+                break;
+        }
+    }
+}
+
+bool Regex::find(std::string_view text, size_t& begin, size_t& end, Cache& cache, bool decodeWords) const {
+    // The DFA rejects non-matching text far faster than the Pike VM can, but
+    // its \b only knows bytes
+    decodeWords = decodeWords && wordAssertions;
+    if (decodeWords) {
+        prepare(cache);
+    } else if (!matches(text, cache)) {
+        return false;
+    }
+
+    auto& current = cache.current;
+    auto& next = cache.next;
+    current.clear();
+    if (++cache.generation == 0) {
+        std::fill(cache.marks.begin(), cache.marks.end(), 0);
+        cache.generation = 1;
+    }
+
+    bool found = false;
+    size_t bestBegin = 0;
+    size_t bestEnd = 0;
+
+    for (size_t pos = 0; pos <= text.size(); ++pos) {
+        if (!found) addThread(cache, current, start, pos, text, pos, decodeWords);
+        if (current.empty() && (found || (!restartable && pos > 0))) break;
+
+        next.clear();
+        if (++cache.generation == 0) {
+            std::fill(cache.marks.begin(), cache.marks.end(), 0);
+            cache.generation = 1;
+        }
+
+        for (const auto& thread : current) {
+            const Inst& inst = program[thread.first];
+            if (inst.op == Match) {
+                if (!longest) {
+                    // Every thread after this one has lower priority
+                    found = true;
+                    bestBegin = thread.second;
+                    bestEnd = pos;
+                    break;
+                }
+                if (!found || thread.second < bestBegin || (thread.second == bestBegin && pos > bestEnd)) {
+                    found = true;
+                    bestBegin = thread.second;
+                    bestEnd = pos;
+                }
+                continue;
+            }
+            if (longest && found && thread.second > bestBegin) continue;
+            if (pos < text.size() && sets[inst.x].test(static_cast<unsigned char>(text[pos]))) {
+                addThread(cache, next, thread.first + 1, thread.second, text, pos + 1, decodeWords);
+            }
+        }
+        current.swap(next);
+    }
+
+    if (found) {
+        begin = bestBegin;
+        end = bestEnd;
+    }
+    return found;
+}
@@ -0,0 +1,112 @@
+#ifndef REGEX_H
+#define REGEX_H
+
+#include <bitset>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Thrown for malformed patterns, and for constructs this engine cannot run
+// in linear time (backreferences, lookaround) so callers can fall back
+class RegexError : public std::runtime_error {
+public:
+    RegexError(const std::string& message, bool unsupported)
+        : std::runtime_error(message), unsupportedFeature(unsupported) {}
+    bool isUnsupported() const { return unsupportedFeature; }
+
+private:
+    bool unsupportedFeature;
+};
+
+// Byte-oriented regex engine for the ECMAScript/ERE subset grep exposes.
+// Patterns compile to a Thompson NFA; yes/no matching runs on a DFA built
+// lazily from it, and match spans come from a Pike VM, so every search is
+// linear in the length of the line.
+class Regex {
+public:
+    // Per-thread scratch: the lazily built DFA and the Pike VM thread lists.
+    // A Regex is immutable and can be shared once each thread has a Cache.
+    class Cache {
+    public:
+        Cache();
+
+    private:
+        friend class Regex;
+        std::vector<int32_t> table;
+        std::vector<int8_t> endMatch;
+        std::vector<std::vector<int32_t>> keys;
+        std::map<std::vector<int32_t>, int32_t> ids;
+        std::vector<uint32_t> marks;
+        uint32_t generation;
+        std::vector<int32_t> stack;
+        std::vector<int32_t> closure;
+        std::vector<std::pair<int32_t, size_t>> current;
+        std::vector<std::pair<int32_t, size_t>> next;
+    };
+
+    // A string every match contains. With ignoreCase the text is lower case
+    // and has to be compared without regard to ASCII case.
+    struct Factor {
+        std::string text;
+        bool ignoreCase;
+    };
+
+    // longest selects POSIX leftmost-longest spans instead of leftmost-first
+    Regex(const std::string& pattern, bool ignoreCase, bool longest = false);
+
+    bool matches(std::string_view text, Cache& cache) const;
+
+    // With decodeWords, \b and \B judge UTF-8 characters rather than bytes.
+    // That bypasses the DFA, so it is only meant for lines that are not ASCII.
+    bool find(std::string_view text, size_t& begin, size_t& end, Cache& cache, bool decodeWords = false) const;
+
+    bool hasWordAssertions() const { return wordAssertions; }
+
+    // Literal factors found by walking the pattern; empty if there are none
+    const std::vector<Factor>& requiredFactors() const { return factors; }
+
+private:
+    enum Op : uint8_t { ByteSet, Split, Jump, Match, AssertBol, AssertEol, AssertWord, AssertNotWord };
+
+    struct Inst {
+        Op op;
+        int32_t x;  // set index for ByteSet, first branch for Split, target for Jump
+        int32_t y;  // second (lower priority) branch for Split
+    };
+
+    // Context an assertion is checked against: what lies either side of a position
+    struct Position {
+        bool atStart;
+        bool prevWord;
+        bool nextWord;
+        bool atEnd;
+    };
+
+    std::vector<Inst> program;
+    std::vector<std::bitset<256>> sets;
+    std::vector<Factor> factors;
+    int32_t start;
+    bool longest;
+    bool restartable;
+    bool wordAssertions;
+    uint8_t classOf[256];
+    std::vector<uint8_t> classByte;
+
+    friend class RegexParser;
+
+    void buildByteClasses();
+    bool assertionHolds(Op op, const Position& at) const;
+    bool follow(const std::vector<int32_t>& from, bool withStart, const Position& at,
+                Cache& cache, std::vector<int32_t>& consumers) const;
+    void prepare(Cache& cache) const;
+    int32_t addState(Cache& cache, std::vector<int32_t>& key) const;
+    int32_t transition(Cache& cache, int32_t state, uint8_t byteClass) const;
+    bool matchesAtEnd(Cache& cache, int32_t state) const;
+    void addThread(Cache& cache, std::vector<std::pair<int32_t, size_t>>& list, int32_t pc, size_t begin,
+                   std::string_view text, size_t pos, bool decodeWords) const;
+};
+
+#endif
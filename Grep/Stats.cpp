@@ -0,0 +1,69 @@
+#include "Stats.h"
+#include <chrono>
+#include <cstdio>
+
+namespace {
+
+// One row of the report: a label for text output, a key for JSON
+struct Field {
+    const char* label;
+    const char* key;
+    uint64_t value;
+    bool time;
+};
+
+}
+
+uint64_t Stats::now() {
+    auto elapsed = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+void Stats::add(const Stats& other) {
+    files += other.files;
+    bytesRead += other.bytesRead;
+    linesScanned += other.linesScanned;
+    regexCalls += other.regexCalls;
+    matches += other.matches;
+    outputBytes += other.outputBytes;
+    threads += other.threads;
+    readNanos += other.readNanos;
+    matchNanos += other.matchNanos;
+    printNanos += other.printNanos;
+    wallNanos += other.wallNanos;
+}
+
+std::string Stats::format(bool json) const {
+    const Field fields[] = {
+        {"files", "files", files, false},
+        {"bytes read", "bytes_read", bytesRead, false},
+        {"lines scanned", "lines_scanned", linesScanned, false},
+        {"regex calls", "regex_calls", regexCalls, false},
+        {"matches", "matches", matches, false},
+        {"output bytes", "output_bytes", outputBytes, false},
+        {"threads", "threads", threads, false},
+        {"read time", "read_ns", readNanos, true},
+        {"match time", "match_ns", matchNanos, true},
+        {"print time", "print_ns", printNanos, true},
+        {"wall time", "wall_ns", wallNanos, true},
+    };
+
+    std::string out = json ? "{" : "";
+    char line[96];
+    bool first = true;
+    for (const auto& field : fields) {
+        if (json) {
+            std::snprintf(line, sizeof(line), "%s\"%s\": %llu", first ? "" : ", ", field.key,
+                          static_cast<unsigned long long>(field.value));
+        } else if (field.time) {
+            std::snprintf(line, sizeof(line), "%-14s %12.3f ms\n", field.label, field.value / 1e6);
+        } else {
+            std::snprintf(line, sizeof(line), "%-14s %12llu\n", field.label,
+                          static_cast<unsigned long long>(field.value));
+        }
+        out += line;
+        first = false;
+    }
+    if (json) out += "}\n";
+    return out;
+}
@@ -0,0 +1,44 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <cstdint>
+#include <string>
+
+// Instrumentation is built in unless GREP_STATS is defined to 0, in which
+// case every GREP_STAT(...) statement disappears and --stats reports nothing
+#ifndef GREP_STATS
+#define GREP_STATS 1
+#endif
+
+#if GREP_STATS
+#define GREP_STAT(...) __VA_ARGS__
+#else
+#define GREP_STAT(...)
+#endif
+
+// Work counters and phase timers. Each worker thread owns one and adds it
+// to the engine's total when it exits, so counting needs no atomics. Timers
+// are only read when --stats asked for them. Mapped input is faulted in
+// while it is scanned, so for mapped files that I/O shows up as match time.
+struct Stats {
+    uint64_t files = 0;
+    uint64_t bytesRead = 0;
+    // Every line, including those the literal prefilter steps over
+    uint64_t linesScanned = 0;
+    uint64_t regexCalls = 0;
+    uint64_t matches = 0;
+    uint64_t outputBytes = 0;
+    uint64_t threads = 0;
+    // Summed over threads, so they can add up to more than the wall time
+    uint64_t readNanos = 0;
+    uint64_t matchNanos = 0;
+    uint64_t printNanos = 0;
+    uint64_t wallNanos = 0;
+
+    static uint64_t now();
+
+    void add(const Stats& other);
+    std::string format(bool json) const;
+};
+
+#endif
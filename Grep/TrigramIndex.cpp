@@ -0,0 +1,279 @@
+#include "TrigramIndex.h"
+#include "ByteScan.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <unordered_map>
+
+namespace {
+
+const char kMagic[8] = {'G', 'I', 'D', 'X', '0', '0', '0', '1'};
+const size_t kBlockSize = 64 * 1024;
+const size_t kTailSize = 4096;
+
+int64_t modificationTime(const std::string& filename, std::error_code& error) {
+    return std::filesystem::last_write_time(filename, error).time_since_epoch().count();
+}
+
+// FNV-1a; only used to notice that a file was rewritten rather than appended to
+uint64_t hashBytes(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// ASCII only, so an index means the same thing under every locale
+uint32_t fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+void putVarint(std::string& out, uint32_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+}
+
+bool TrigramIndex::makeQuery(const std::vector<std::vector<std::string>>& literals, Query& query) {
+    query.clear();
+    for (const auto& alternative : literals) {
+        std::vector<uint32_t> trigrams;
+        for (const auto& literal : alternative) {
+            for (size_t i = 0; i + 3 <= literal.size(); ++i) {
+                trigrams.push_back(fold(literal[i]) << 16 | fold(literal[i + 1]) << 8 | fold(literal[i + 2]));
+            }
+        }
+        if (trigrams.empty()) return false;
+        std::sort(trigrams.begin(), trigrams.end());
+        trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+        query.push_back(std::move(trigrams));
+    }
+    return !query.empty();
+}
+
+std::string TrigramIndex::pathFor(const std::string& filename) {
+    return filename + ".gidx";
+}
+
+bool TrigramIndex::build(const std::string& filename, std::string& error) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        error = "Could not open file: " + filename;
+        return false;
+    }
+    std::error_code timeError;
+    int64_t mtime = modificationTime(filename, timeError);
+    if (timeError) {
+        error = "Could not stat file: " + filename;
+        return false;
+    }
+    const char* data = file.data();
+    size_t size = file.size();
+
+    // Reuse what an older index says about a prefix the file still starts with
+    TrigramIndex old;
+    size_t keepBlocks = 0;
+    if (old.load(pathFor(filename))) {
+        if (old.header->fileSize == size && old.header->mtime == mtime) return true;
+        size_t oldSize = old.header->fileSize;
+        size_t tail = std::min(kTailSize, oldSize);
+        if (oldSize <= size && hashBytes(data + oldSize - tail, tail) == old.header->tailHash &&
+            old.blockCount() > 0) {
+            // The last old block may have ended mid-line, so it is indexed again
+            keepBlocks = old.blockCount() - 1;
+        }
+    }
+
+    std::vector<BlockEntry> blockTable(old.blocks, old.blocks + keepBlocks);
+    std::unordered_map<uint32_t, std::vector<uint32_t>> lists;
+    if (keepBlocks > 0) {
+        std::vector<uint32_t> ids;
+        for (uint32_t t = 0; t < old.header->trigramCount; ++t) {
+            if (!old.decode(old.trigrams[t], ids)) {
+                // Damaged, so start over from scratch
+                lists.clear();
+                blockTable.clear();
+                keepBlocks = 0;
+                break;
+            }
+            auto last = std::lower_bound(ids.begin(), ids.end(), keepBlocks);
+            if (last != ids.begin()) lists[old.trigrams[t].trigram].assign(ids.begin(), last);
+        }
+    }
+
+    size_t pos = keepBlocks > 0 ? old.blockBegin(keepBlocks) : 0;
+    uint64_t lines = keepBlocks > 0 ? old.blocks[keepBlocks].linesBefore : 0;
+    std::vector<uint32_t> seen;
+    while (pos < size) {
+        size_t end = pos + kBlockSize;
+        if (end >= size) {
+            end = size;
+        } else {
+            const void* newline = std::memchr(data + end, '\n', size - end);
+            end = newline ? static_cast<const char*>(newline) - data + 1 : size;
+        }
+
+        // Lines are matched one at a time, so trigrams across a newline never help
+        seen.clear();
+        for (size_t i = pos; i + 3 <= end; ++i) {
+            if (data[i] == '\n' || data[i + 1] == '\n' || data[i + 2] == '\n') continue;
+            seen.push_back(fold(data[i]) << 16 | fold(data[i + 1]) << 8 | fold(data[i + 2]));
+        }
+        std::sort(seen.begin(), seen.end());
+        seen.erase(std::unique(seen.begin(), seen.end()), seen.end());
+
+        uint32_t id = blockTable.size();
+        for (uint32_t trigram : seen) lists[trigram].push_back(id);
+        blockTable.push_back({pos, lines});
+        lines += ByteScan::countNewlines(data + pos, data + end);
+        pos = end;
+    }
+
+    std::vector<uint32_t> order;
+    order.reserve(lists.size());
+    for (const auto& list : lists) order.push_back(list.first);
+    std::sort(order.begin(), order.end());
+
+    std::vector<TrigramEntry> trigramTable;
+    std::string postingData;
+    for (uint32_t trigram : order) {
+        const auto& ids = lists[trigram];
+        trigramTable.push_back({trigram, static_cast<uint32_t>(ids.size()), postingData.size()});
+        uint32_t previous = 0;
+        for (uint32_t id : ids) {
+            putVarint(postingData, id - previous);
+            previous = id;
+        }
+    }
+
+    Header header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.fileSize = size;
+    header.mtime = mtime;
+    size_t tail = std::min(kTailSize, size);
+    header.tailHash = hashBytes(data + size - tail, tail);
+    header.blockSize = kBlockSize;
+    header.blockCount = blockTable.size();
+    header.trigramCount = trigramTable.size();
+    header.reserved = 0;
+
+    // Written aside and renamed, so readers never map a half-written index
+    std::string path = pathFor(filename);
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(blockTable.data()), blockTable.size() * sizeof(BlockEntry));
+        out.write(reinterpret_cast<const char*>(trigramTable.data()), trigramTable.size() * sizeof(TrigramEntry));
+        out.write(postingData.data(), postingData.size());
+        if (!out) {
+            std::remove(temporary.c_str());
+            error = "Could not write index: " + path;
+            return false;
+        }
+    }
+    old.mapped.close();
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        error = "Could not write index: " + path;
+        return false;
+    }
+    return true;
+}
+
+TrigramIndex::TrigramIndex()
+    : header(nullptr), blocks(nullptr), trigrams(nullptr), postings(nullptr), postingsEnd(nullptr) {}
+
+bool TrigramIndex::open(const std::string& filename) {
+    if (!load(pathFor(filename))) return false;
+
+    std::error_code error;
+    uint64_t size = std::filesystem::file_size(filename, error);
+    if (error || size != header->fileSize) return false;
+    int64_t mtime = modificationTime(filename, error);
+    return !error && mtime == header->mtime;
+}
+
+bool TrigramIndex::load(const std::string& path) {
+    header = nullptr;
+    if (!mapped.open(path) || mapped.size() < sizeof(Header)) return false;
+
+    const Header* candidate = reinterpret_cast<const Header*>(mapped.data());
+    if (std::memcmp(candidate->magic, kMagic, sizeof(kMagic)) != 0) return false;
+    size_t tables = sizeof(Header) + candidate->blockCount * sizeof(BlockEntry) +
+                    candidate->trigramCount * sizeof(TrigramEntry);
+    if (mapped.size() < tables) return false;
+
+    header = candidate;
+    blocks = reinterpret_cast<const BlockEntry*>(mapped.data() + sizeof(Header));
+    trigrams = reinterpret_cast<const TrigramEntry*>(blocks + header->blockCount);
+    postings = reinterpret_cast<const unsigned char*>(mapped.data()) + tables;
+    postingsEnd = reinterpret_cast<const unsigned char*>(mapped.data()) + mapped.size();
+    return true;
+}
+
+size_t TrigramIndex::blockEnd(size_t block) const {
+    return block + 1 < header->blockCount ? blocks[block + 1].offset : header->fileSize;
+}
+
+void TrigramIndex::candidates(const Query& query, std::vector<char>& result) const {
+    size_t count = header->blockCount;
+    result.assign(count, 0);
+
+    std::vector<char> all(count);
+    std::vector<uint32_t> ids;
+    for (const auto& alternative : query) {
+        std::fill(all.begin(), all.end(), 1);
+        for (uint32_t trigram : alternative) {
+            const TrigramEntry* entry = lookup(trigram);
+            if (!entry) {
+                std::fill(all.begin(), all.end(), 0);
+                break;
+            }
+            // A damaged list cannot rule anything out
+            if (!decode(*entry, ids)) continue;
+            size_t next = 0;
+            for (uint32_t id : ids) {
+                while (next < id) all[next++] = 0;
+                next = id + 1;
+            }
+            while (next < count) all[next++] = 0;
+        }
+        for (size_t b = 0; b < count; ++b) result[b] |= all[b];
+    }
+}
+
+const TrigramIndex::TrigramEntry* TrigramIndex::lookup(uint32_t trigram) const {
+    const TrigramEntry* end = trigrams + header->trigramCount;
+    const TrigramEntry* it = std::lower_bound(
+        trigrams, end, trigram, [](const TrigramEntry& entry, uint32_t value) { return entry.trigram < value; });
+    return it != end && it->trigram == trigram ? it : nullptr;
+}
+
+bool TrigramIndex::decode(const TrigramEntry& entry, std::vector<uint32_t>& ids) const {
+    ids.clear();
+    const unsigned char* p = postings + entry.offset;
+    uint32_t id = 0;
+    for (uint32_t i = 0; i < entry.count; ++i) {
+        uint32_t delta = 0;
+        for (int shift = 0;; shift += 7) {
+            if (p >= postingsEnd || shift > 28) return false;
+            unsigned char byte = *p++;
+            delta |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        id += delta;
+        if (id >= header->blockCount || (i > 0 && delta == 0)) return false;
+        ids.push_back(id);
+    }
+    return true;
+}
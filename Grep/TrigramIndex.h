@@ -0,0 +1,80 @@
+#ifndef TRIGRAMINDEX_H
+#define TRIGRAMINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+// Sidecar index (<file>.gidx) recording which ASCII-lowercased trigrams
+// occur in each newline-aligned block of roughly 64 KiB. It is mapped
+// read-only; posting lists are delta-encoded varints. An index is used
+// only while the file's size and mtime still match the ones it was built
+// for. The layout is native-endian and meant for the machine that built it.
+class TrigramIndex {
+public:
+    // Trigram sets, one per alternative pattern. A block can match if it
+    // holds every trigram of at least one of them.
+    using Query = std::vector<std::vector<uint32_t>>;
+
+    // Builds a query from the literals each alternative requires; false if
+    // some alternative has no trigram at all, so nothing can be ruled out
+    static bool makeQuery(const std::vector<std::vector<std::string>>& literals, Query& query);
+
+    static std::string pathFor(const std::string& filename);
+
+    // Writes or refreshes filename's index. If the file has only been
+    // appended to since, the existing blocks are kept and only the tail is
+    // indexed again.
+    static bool build(const std::string& filename, std::string& error);
+
+    TrigramIndex();
+
+    // Maps the index for filename if there is one and it is up to date
+    bool open(const std::string& filename);
+
+    size_t blockCount() const { return header->blockCount; }
+    size_t blockBegin(size_t block) const { return blocks[block].offset; }
+    size_t blockEnd(size_t block) const;
+    long linesBefore(size_t block) const { return static_cast<long>(blocks[block].linesBefore); }
+
+    // Sets one flag per block: whether it may contain a match for query
+    void candidates(const Query& query, std::vector<char>& result) const;
+
+private:
+    struct Header {
+        char magic[8];
+        uint64_t fileSize;
+        int64_t mtime;
+        uint64_t tailHash;  // hash of the last few KiB, to recognise an appended file
+        uint32_t blockSize;
+        uint32_t blockCount;
+        uint32_t trigramCount;
+        uint32_t reserved;
+    };
+
+    struct BlockEntry {
+        uint64_t offset;
+        uint64_t linesBefore;
+    };
+
+    struct TrigramEntry {
+        uint32_t trigram;
+        uint32_t count;
+        uint64_t offset;  // into the posting area
+    };
+
+    MappedFile mapped;
+    const Header* header;
+    const BlockEntry* blocks;
+    const TrigramEntry* trigrams;
+    const unsigned char* postings;
+    const unsigned char* postingsEnd;
+
+    bool load(const std::string& path);
+    const TrigramEntry* lookup(uint32_t trigram) const;
+    bool decode(const TrigramEntry& entry, std::vector<uint32_t>& ids) const;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include "Utf8.h"
+#include <algorithm>
+#include <cstring>
+#include <cwctype>
+#include <langinfo.h>
+
+namespace {
+
+char32_t decodeSequence(std::string_view text, size_t length) {
+    static const unsigned char kLeadMask[] = {0, 0, 0x1f, 0x0f, 0x07};
+    char32_t value = static_cast<unsigned char>(text[0]) & kLeadMask[length];
+    for (size_t i = 1; i < length; ++i) value = value << 6 | (static_cast<unsigned char>(text[i]) & 0x3f);
+    return value;
+}
+
+bool isValid(char32_t value) {
+    return value < 0x110000 && (value < 0xd800 || value > 0xdfff);
+}
+
+bool isAsciiWord(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+}
+
+size_t Utf8::sequenceLength(std::string_view text) {
+    if (text.empty()) return 0;
+    unsigned char lead = text[0];
+    size_t length = lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : lead >= 0xc0 ? 2 : 0;
+    if (length == 0 || text.size() < length) return 0;
+    for (size_t i = 1; i < length; ++i) {
+        if ((static_cast<unsigned char>(text[i]) & 0xc0) != 0x80) return 0;
+    }
+
+    // Overlong forms and surrogates are not characters
+    static const char32_t kMinimum[] = {0, 0, 0x80, 0x800, 0x10000};
+    char32_t value = decodeSequence(text, length);
+    return value >= kMinimum[length] && isValid(value) ? length : 0;
+}
+
+char32_t Utf8::decode(std::string_view text) {
+    return decodeSequence(text, sequenceLength(text));
+}
+
+std::string Utf8::encode(char32_t value) {
+    std::string out;
+    if (value < 0x80) {
+        out += static_cast<char>(value);
+    } else if (value < 0x800) {
+        out += static_cast<char>(0xc0 | value >> 6);
+        out += static_cast<char>(0x80 | (value & 0x3f));
+    } else if (value < 0x10000) {
+        out += static_cast<char>(0xe0 | value >> 12);
+        out += static_cast<char>(0x80 | (value >> 6 & 0x3f));
+        out += static_cast<char>(0x80 | (value & 0x3f));
+    } else {
+        out += static_cast<char>(0xf0 | value >> 18);
+        out += static_cast<char>(0x80 | (value >> 12 & 0x3f));
+        out += static_cast<char>(0x80 | (value >> 6 & 0x3f));
+        out += static_cast<char>(0x80 | (value & 0x3f));
+    }
+    return out;
+}
+
+std::vector<std::string> Utf8::caseVariants(std::string_view character) {
+    size_t length = sequenceLength(character);
+    if (length == 0) return {std::string(character.substr(0, 1))};
+
+    char32_t original = decodeSequence(character, length);
+    std::vector<std::string> variants{std::string(character.substr(0, length))};
+    // Going through the other case and back also catches pairs like U+017F and 's'
+    char32_t lower = std::towlower(original);
+    char32_t upper = std::towupper(original);
+    for (char32_t value : {lower, upper, char32_t(std::towlower(upper)), char32_t(std::towupper(lower))}) {
+        if (!isValid(value)) continue;
+        std::string text = encode(value);
+        if (std::find(variants.begin(), variants.end(), text) == variants.end()) variants.push_back(text);
+    }
+    return variants;
+}
+
+bool Utf8::hasCaseVariants(std::string_view text) {
+    for (size_t i = 0; i < text.size(); ++i) {
+        size_t length = sequenceLength(text.substr(i));
+        if (length == 0) continue;
+        if (caseVariants(text.substr(i, length)).size() > 1) return true;
+        i += length - 1;
+    }
+    return false;
+}
+
+bool Utf8::localeIsUtf8() {
+    // main sets the locale before anything asks, and it never changes after
+    static const bool utf8 = std::strcmp(nl_langinfo(CODESET), "UTF-8") == 0;
+    return utf8;
+}
+
+bool Utf8::isWordAt(std::string_view text, size_t pos) {
+    if (pos >= text.size()) return false;
+    unsigned char c = text[pos];
+    if (c < 0x80) return isAsciiWord(c);
+    if (!localeIsUtf8()) return false;
+
+    // Back up over continuation bytes to the lead byte of this character
+    size_t start = pos;
+    while (start > 0 && pos - start < 3 && (static_cast<unsigned char>(text[start]) & 0xc0) == 0x80) --start;
+    size_t length = sequenceLength(text.substr(start));
+    if (length == 0 || start + length <= pos) return false;
+    return std::iswalnum(decodeSequence(text.substr(start), length)) != 0;
+}
+
+bool Utf8::isWordBefore(std::string_view text, size_t pos) {
+    return pos > 0 && isWordAt(text, pos - 1);
+}
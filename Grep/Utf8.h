@@ -0,0 +1,37 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The few places where grep has to look past bytes at UTF-8 characters.
+// Case mapping goes through towlower/towupper, so it follows LC_CTYPE and
+// does nothing in the C locale; ASCII is always folded byte by byte instead.
+namespace Utf8 {
+    // Length of the well-formed multibyte character text starts with, or 0
+    size_t sequenceLength(std::string_view text);
+
+    // Code point of the character text starts with; sequenceLength must be nonzero
+    char32_t decode(std::string_view text);
+    std::string encode(char32_t value);
+
+    // Every case of the character text starts with, itself first
+    std::vector<std::string> caseVariants(std::string_view character);
+
+    // True if some multibyte character in text has another case
+    bool hasCaseVariants(std::string_view text);
+
+    // Whether LC_CTYPE is a UTF-8 locale; otherwise bytes above 0x7f are
+    // never read as characters
+    bool localeIsUtf8();
+
+    // Word-ness (alphanumeric or '_') of the character at, or just before,
+    // byte offset pos. Inside a multibyte character both sides see that
+    // character, so no word boundary falls there.
+    bool isWordAt(std::string_view text, size_t pos);
+    bool isWordBefore(std::string_view text, size_t pos);
+}
+
+#endif
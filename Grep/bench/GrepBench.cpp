@@ -0,0 +1,492 @@
+// Throughput benchmark for the grep binary. It writes a fixed set of
+// synthetic corpora (the same bytes on every machine for a given --scale),
+// runs each search mode against them and prints the timings as JSON.
+//
+//   g++ -std=c++17 -O2 -o grepbench bench/GrepBench.cpp
+//   ./grepbench --grep ./grep > results.json
+//   ./grepbench --grep ./grep --baseline results.json --tolerance 10
+//
+// With --baseline, a case whose median time is more than --tolerance
+// percent slower than the baseline is reported and the exit status is 1.
+// So is a check whose commands, which must print the same bytes, differ.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Bump when a generator changes, so stale corpora are written again
+const int kCorpusVersion = 1;
+
+const size_t kMiB = 1024 * 1024;
+
+// Corpus sizes at --scale 1
+const size_t kLogSize = 32 * kMiB;
+const size_t kLongLineSize = 16 * kMiB;
+const size_t kHugeSize = 128 * kMiB;
+const size_t kSmallFileCount = 2000;
+const size_t kSmallFileSize = 4096;
+
+// Planted in roughly one log line in this many, for the low match rate cases
+const uint64_t kRareEvery = 50000;
+const char kRareToken[] = "needle-7731";
+
+const char* const kLevels[] = {"DEBUG", "INFO", "INFO", "INFO", "WARN", "ERROR"};
+const char* const kComponents[] = {"http", "db", "cache", "auth", "scheduler", "queue", "storage", "mailer"};
+const char* const kWords[] = {
+    "request", "handled", "connection", "opened", "closed", "retry", "timeout", "user", "session",
+    "token", "expired", "query", "returned", "rows", "flushed", "segment", "compaction", "started",
+    "finished", "worker", "job", "enqueued", "payload", "checksum", "mismatch", "replica", "lagging",
+    "Lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit", "sed", "tempor"};
+
+template <typename T, size_t N>
+constexpr size_t countOf(const T (&)[N]) {
+    return N;
+}
+
+// SplitMix64: tiny, and unlike the <random> distributions it produces the
+// same sequence with every standard library
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    size_t below(size_t bound) { return next() % bound; }
+
+private:
+    uint64_t state;
+};
+
+struct Settings {
+    std::string grep = "./grep";
+    std::string directory = "grepbench-data";
+    std::string baseline;
+    std::string filter;
+    double scale = 1.0;
+    double tolerance = 10.0;
+    int repeat = 5;
+};
+
+struct Case {
+    std::string name;
+    std::vector<std::string> args;
+    // Input size used for the throughput figure
+    uint64_t bytes;
+};
+
+// Commands that must print exactly what expected prints. Each runs
+// --repeat times, since thread scheduling is what would tell them apart.
+struct Check {
+    std::string name;
+    std::vector<std::string> expected;
+    std::vector<std::vector<std::string>> others;
+};
+
+struct Result {
+    std::string name;
+    std::string command;
+    uint64_t bytes;
+    double minimum;
+    double median;
+    int status;
+};
+
+void appendLogLine(std::string& out, Random& random, uint64_t lineNumber) {
+    char head[64];
+    uint64_t seconds = lineNumber / 7;
+    std::snprintf(head, sizeof(head), "2024-03-%02u %02u:%02u:%02u.%03u ", static_cast<unsigned>(1 + seconds / 86400 % 28),
+                  static_cast<unsigned>(seconds / 3600 % 24), static_cast<unsigned>(seconds / 60 % 60),
+                  static_cast<unsigned>(seconds % 60), static_cast<unsigned>(random.below(1000)));
+    out += head;
+    out += kLevels[random.below(countOf(kLevels))];
+    out += " [";
+    out += kComponents[random.below(countOf(kComponents))];
+    out += "] ";
+    size_t words = 4 + random.below(8);
+    for (size_t w = 0; w < words; ++w) {
+        out += kWords[random.below(countOf(kWords))];
+        out += ' ';
+    }
+    if (random.below(kRareEvery) == 0) {
+        out += kRareToken;
+        out += ' ';
+    }
+    out += "user=u";
+    out += std::to_string(random.below(100000));
+    out += " took ";
+    out += std::to_string(random.below(2000));
+    out += "ms\n";
+}
+
+bool writeFile(const fs::path& path, const std::string& data) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), data.size());
+    return static_cast<bool>(out);
+}
+
+bool writeLogFile(const fs::path& path, size_t size, uint64_t seed) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    Random random(seed);
+    std::string block;
+    uint64_t lineNumber = 0;
+    size_t written = 0;
+    while (written < size) {
+        block.clear();
+        while (block.size() < kMiB) appendLogLine(block, random, lineNumber++);
+        out.write(block.data(), block.size());
+        written += block.size();
+    }
+    return static_cast<bool>(out);
+}
+
+// Lines of 16-128 KiB, far beyond anything a line-at-a-time reader expects
+bool writeLongLines(const fs::path& path, size_t size, uint64_t seed) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    Random random(seed);
+    std::string line;
+    size_t written = 0;
+    while (written < size) {
+        line.clear();
+        size_t length = (16 + random.below(112)) * 1024;
+        while (line.size() < length) {
+            line += kWords[random.below(countOf(kWords))];
+            line += random.below(kRareEvery / 100) == 0 ? " needle-7731 " : " ";
+        }
+        line += '\n';
+        out.write(line.data(), line.size());
+        written += line.size();
+    }
+    return static_cast<bool>(out);
+}
+
+bool writeSmallFiles(const fs::path& root, size_t count, uint64_t seed) {
+    Random random(seed);
+    std::string data;
+    uint64_t lineNumber = 0;
+    for (size_t i = 0; i < count; ++i) {
+        fs::path directory = root / ("d" + std::to_string(i % 20)) / ("e" + std::to_string(i % 7));
+        std::error_code error;
+        fs::create_directories(directory, error);
+        data.clear();
+        while (data.size() < kSmallFileSize) appendLogLine(data, random, lineNumber++);
+        if (!writeFile(directory / ("f" + std::to_string(i) + ".log"), data)) return false;
+    }
+    return true;
+}
+
+// Patterns for the many-pattern case, one per line
+bool writePatternFile(const fs::path& path) {
+    std::string data;
+    for (size_t i = 0; i < 200; ++i) data += "u" + std::to_string(99000 + i) + " took\n";
+    return writeFile(path, data);
+}
+
+bool prepareCorpora(const Settings& settings, const fs::path& root) {
+    std::ostringstream stamp;
+    stamp << "version " << kCorpusVersion << " scale " << settings.scale << "\n";
+    fs::path stampPath = root / "STAMP";
+    std::ifstream existing(stampPath);
+    std::string previous((std::istreambuf_iterator<char>(existing)), std::istreambuf_iterator<char>());
+    if (previous == stamp.str()) return true;
+
+    std::cerr << "Generating corpora in " << root.string() << "\n";
+    std::error_code error;
+    fs::remove_all(root, error);
+    fs::create_directories(root, error);
+    if (error) return false;
+
+    auto scaled = [&](size_t size) { return std::max<size_t>(kMiB, static_cast<size_t>(size * settings.scale)); };
+    size_t smallFiles = std::max<size_t>(1, static_cast<size_t>(kSmallFileCount * settings.scale));
+    bool written = writeLogFile(root / "logs.log", scaled(kLogSize), 1) &&
+                   writeLongLines(root / "long.txt", scaled(kLongLineSize), 2) &&
+                   writeLogFile(root / "huge.log", scaled(kHugeSize), 3) &&
+                   writeSmallFiles(root / "many", smallFiles, 4) && writePatternFile(root / "patterns.txt");
+    // The stamp goes last, so an interrupted run starts over
+    return written && writeFile(stampPath, stamp.str());
+}
+
+uint64_t treeSize(const fs::path& path) {
+    std::error_code error;
+    if (!fs::is_directory(path, error)) return fs::file_size(path, error);
+    uint64_t total = 0;
+    for (fs::recursive_directory_iterator it(path, error), end; !error && it != end; it.increment(error)) {
+        if (it->is_regular_file(error)) total += it->file_size(error);
+    }
+    return total;
+}
+
+std::vector<Case> makeCases(const fs::path& root) {
+    std::string logs = (root / "logs.log").string();
+    std::string longLines = (root / "long.txt").string();
+    std::string huge = (root / "huge.log").string();
+    std::string many = (root / "many").string();
+    std::string patterns = (root / "patterns.txt").string();
+
+    std::vector<Case> cases = {
+        {"literal_high_rate", {"INFO", logs}, 0},
+        {"literal_low_rate", {kRareToken, logs}, 0},
+        {"literal_no_match", {"no-such-token", logs}, 0},
+        {"regex", {"-E", "took [0-9]{4}ms", logs}, 0},
+        {"regex_alternation", {"-E", "(timeout|mismatch) .*user=u9", logs}, 0},
+        {"ignore_case", {"-i", "error", logs}, 0},
+        {"ignore_case_regex", {"-i", "-E", "replica +lagging", logs}, 0},
+        {"invert", {"-v", "INFO", logs}, 0},
+        {"count", {"-c", "ERROR", logs}, 0},
+        {"count_invert", {"-c", "-v", "ERROR", logs}, 0},
+        {"context", {"-n", "-C", "2", "mismatch", logs}, 0},
+        {"only_matching", {"-o", "-E", "user=u[0-9]+", logs}, 0},
+        {"multi_pattern", {"-e", "timeout", "-e", "expired", "-e", "lagging", "-e", "mismatch", logs}, 0},
+        {"pattern_file", {"-f", patterns, logs}, 0},
+        {"long_lines", {kRareToken, longLines}, 0},
+        {"long_lines_regex", {"-E", "needle-[0-9]+", longLines}, 0},
+        {"many_files", {"-r", "-c", "ERROR", many}, 0},
+        {"many_files_parallel", {"-r", "-j", "4", "-l", kRareToken, many}, 0},
+        {"huge_file", {"-c", "ERROR", huge}, 0},
+        {"huge_file_parallel", {"-j", "4", "-c", "ERROR", huge}, 0},
+    };
+    std::map<std::string, uint64_t> sizes;
+    for (const auto& input : {logs, longLines, huge, many}) sizes[input] = treeSize(input);
+    for (auto& c : cases) c.bytes = sizes[c.args.back()];
+    return cases;
+}
+
+std::vector<Check> makeChecks(const fs::path& root) {
+    std::string many = (root / "many").string();
+    return {
+        {"recursive_order", {"-r", "-j", "1", "-n", "ERROR", many},
+         {{"-r", "-j", "8", "-n", "ERROR", many}, {"-r", "-j", "3", "-n", "ERROR", many}}},
+    };
+}
+
+// Runs grep once and collects what it writes to standard output; false if
+// it could not be started or crashed
+bool captureOutput(const Settings& settings, const std::vector<std::string>& args, std::string& output) {
+    std::vector<char*> argv{const_cast<char*>(settings.grep.c_str())};
+    for (const auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    int pipeEnds[2];
+    if (pipe(pipeEnds) != 0) return false;
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = ::open("/dev/null", O_WRONLY);
+        dup2(pipeEnds[1], STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        close(pipeEnds[0]);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    close(pipeEnds[1]);
+    output.clear();
+    char buffer[65536];
+    ssize_t got;
+    while ((got = read(pipeEnds[0], buffer, sizeof(buffer))) > 0) output.append(buffer, got);
+    close(pipeEnds[0]);
+    int raw = 0;
+    if (pid < 0 || waitpid(pid, &raw, 0) < 0) return false;
+    return WIFEXITED(raw) && WEXITSTATUS(raw) <= 1;
+}
+
+bool runCheck(const Settings& settings, const Check& check) {
+    std::string expected, output;
+    if (!captureOutput(settings, check.expected, expected)) {
+        std::cerr << check.name << ": grep failed\n";
+        return false;
+    }
+    for (const auto& args : check.others) {
+        for (int r = 0; r < settings.repeat; ++r) {
+            if (!captureOutput(settings, args, output)) {
+                std::cerr << check.name << ": grep failed\n";
+                return false;
+            }
+            if (output != expected) {
+                std::string command;
+                for (const auto& arg : args) command += " " + arg;
+                std::cerr << "MISMATCH " << check.name << ":" << command << " differs on run " << r + 1 << "\n";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Runs grep once with its output discarded; returns the wall time in
+// seconds and its exit status (-1 if it could not be started or crashed)
+double runOnce(const Settings& settings, const std::vector<std::string>& args, int& status) {
+    std::vector<char*> argv{const_cast<char*>(settings.grep.c_str())};
+    for (const auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    auto started = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = ::open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int raw = 0;
+    if (pid < 0 || waitpid(pid, &raw, 0) < 0) {
+        status = -1;
+        return 0;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+    status = WIFEXITED(raw) ? WEXITSTATUS(raw) : -1;
+    return elapsed.count();
+}
+
+Result runCase(const Settings& settings, const Case& c) {
+    Result result{c.name, settings.grep, c.bytes, 0, 0, 0};
+    for (const auto& arg : c.args) result.command += " " + arg;
+
+    // One untimed run so every case starts with the corpus in the page cache
+    runOnce(settings, c.args, result.status);
+    std::vector<double> times;
+    for (int r = 0; r < settings.repeat && result.status >= 0 && result.status <= 1; ++r) {
+        times.push_back(runOnce(settings, c.args, result.status));
+    }
+    if (times.empty()) return result;
+    std::sort(times.begin(), times.end());
+    result.minimum = times.front();
+    result.median = times[times.size() / 2];
+    return result;
+}
+
+std::string quoted(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+void printJson(const Settings& settings, const std::vector<Result>& results) {
+    std::cout << "{\n  \"grep\": " << quoted(settings.grep) << ",\n  \"scale\": " << settings.scale
+              << ",\n  \"repeat\": " << settings.repeat << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        double throughput = r.median > 0 ? r.bytes / r.median / kMiB : 0;
+        char numbers[160];
+        std::snprintf(numbers, sizeof(numbers),
+                      "\"bytes\": %llu, \"seconds_min\": %.6f, \"seconds_median\": %.6f, \"mib_per_s\": %.1f, "
+                      "\"status\": %d",
+                      static_cast<unsigned long long>(r.bytes), r.minimum, r.median, throughput, r.status);
+        std::cout << "    {\"name\": " << quoted(r.name) << ", \"command\": " << quoted(r.command) << ", "
+                  << numbers << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    std::cout << "  ]\n}\n";
+}
+
+// Reads name -> seconds_median back from a file printJson wrote. Only that
+// layout is understood; this is not a general JSON parser.
+std::map<std::string, double> readBaseline(const std::string& path) {
+    std::map<std::string, double> medians;
+    std::ifstream in(path);
+    std::string line;
+    const std::string nameKey = "\"name\": \"";
+    const std::string medianKey = "\"seconds_median\": ";
+    while (std::getline(in, line)) {
+        size_t name = line.find(nameKey);
+        size_t median = line.find(medianKey);
+        if (name == std::string::npos || median == std::string::npos) continue;
+        name += nameKey.size();
+        medians[line.substr(name, line.find('"', name) - name)] = std::atof(line.c_str() + median + medianKey.size());
+    }
+    return medians;
+}
+
+bool parseArgs(int argc, char* argv[], Settings& settings) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--grep" && hasValue) settings.grep = argv[++i];
+        else if (arg == "--dir" && hasValue) settings.directory = argv[++i];
+        else if (arg == "--baseline" && hasValue) settings.baseline = argv[++i];
+        else if (arg == "--filter" && hasValue) settings.filter = argv[++i];
+        else if (arg == "--scale" && hasValue) settings.scale = std::atof(argv[++i]);
+        else if (arg == "--tolerance" && hasValue) settings.tolerance = std::atof(argv[++i]);
+        else if (arg == "--repeat" && hasValue) settings.repeat = std::atoi(argv[++i]);
+        else {
+            std::cerr << "Usage: grepbench [--grep PATH] [--dir DIR] [--scale X] [--repeat N]\n"
+                         "                 [--filter SUBSTRING] [--baseline FILE] [--tolerance PERCENT]\n";
+            return false;
+        }
+    }
+    return settings.scale > 0 && settings.repeat > 0;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Settings settings;
+    if (!parseArgs(argc, argv, settings)) return 2;
+    if (access(settings.grep.c_str(), X_OK) != 0) {
+        std::cerr << "Not an executable: " << settings.grep << "\n";
+        return 2;
+    }
+
+    fs::path root(settings.directory);
+    if (!prepareCorpora(settings, root)) {
+        std::cerr << "Could not write corpora to " << root.string() << "\n";
+        return 2;
+    }
+
+    bool failed = false;
+    for (const auto& check : makeChecks(root)) {
+        if (check.name.find(settings.filter) == std::string::npos) continue;
+        if (!runCheck(settings, check)) failed = true;
+    }
+
+    std::vector<Result> results;
+    for (const auto& c : makeCases(root)) {
+        if (c.name.find(settings.filter) == std::string::npos) continue;
+        results.push_back(runCase(settings, c));
+        const Result& r = results.back();
+        if (r.status < 0 || r.status > 1) {
+            std::cerr << r.name << ": grep failed with status " << r.status << "\n";
+            failed = true;
+            continue;
+        }
+        std::fprintf(stderr, "%-22s %9.3f s %9.1f MiB/s\n", r.name.c_str(), r.median, r.bytes / r.median / kMiB);
+    }
+    printJson(settings, results);
+
+    if (!settings.baseline.empty()) {
+        auto baseline = readBaseline(settings.baseline);
+        for (const auto& r : results) {
+            auto it = baseline.find(r.name);
+            if (it == baseline.end() || it->second <= 0 || r.median <= 0) continue;
+            double change = (r.median / it->second - 1) * 100;
+            if (change > settings.tolerance) {
+                std::fprintf(stderr, "REGRESSION %s: %.3f s -> %.3f s (%+.1f%%)\n", r.name.c_str(), it->second,
+                             r.median, change);
+                failed = true;
+            }
+        }
+    }
+    return failed ? 1 : 0;
+}
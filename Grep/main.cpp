@@ -1,17 +1,41 @@
 #include "GrepOptions.h"
 #include "GrepEngine.h"
+#include "TrigramIndex.h"
+#include <clocale>
+#include <iostream>
 
 int main(int argc, char* argv[]) {
+    // Only character classification; messages and numbers stay in the C locale
+    std::setlocale(LC_CTYPE, "");
+
     GrepOptions options;
     options.parseArgs(argc, argv);
 
+    // --build-index takes only file names and writes a sidecar index for each
+    if (options.buildIndex) {
+        bool built = true;
+        for (const auto& file : options.files) {
+            std::string error;
+            if (!TrigramIndex::build(file, error)) {
+                std::cerr << error << std::endl;
+                built = false;
+            }
+        }
+        return built ? 0 : 1;
+    }
+
     if (options.patterns.empty() && !options.files.empty()) {
         options.patterns.push_back(options.files.front());
         options.files.erase(options.files.begin());
     }
+    if (options.files.empty()) options.files.push_back(options.recursive ? "." : "-");
 
+    // grep convention: 0 when something matched, 1 when nothing did
     GrepEngine engine(options);
-    engine.searchFiles(options.files);
+    bool matched = engine.searchFiles(options.files);
+#if GREP_STATS
+    if (options.stats) std::cerr << engine.stats().format(options.statsJson);
+#endif
 
-    return 0;
+    return matched ? 0 : 1;
 }
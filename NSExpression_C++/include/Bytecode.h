@@ -0,0 +1,119 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "Expression.h"
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// An expression tree flattened into postfix instructions for a small stack
+// machine. Operators and function names are resolved once when compiling, so
+// evaluating it many times (sampling, root finding) skips the virtual calls
+// and string comparisons of ExpressionNode::evaluate. Results and errors are
+// the same as evaluating the tree.
+class CompiledExpression {
+public:
+    enum class OpCode : uint8_t {
+        Constant,   // push constants[operand]
+        Variable,   // push the value in slot operand
+        Add, Subtract, Multiply, Divide, Power, Negate,
+        Sin, Cos, Tan, Asin, Acos, Atan, Log, Log10, Log2, Exp, Sqrt, Cbrt,
+        Subtree,    // push subtrees[operand]->evaluate(), for node types it does not know
+        Fail        // throw messages[operand]
+    };
+
+    struct Instruction {
+        OpCode op;
+        uint32_t operand;
+    };
+
+    // Why an evaluation stopped; evaluate throws the tree's message for each
+    enum class Status : uint8_t {
+        Ok,
+        DivisionByZero,
+        DomainError,        // asin/acos outside [-1, 1], log of x <= 0, sqrt of x < 0
+        UndefinedVariable,
+        Failed              // unknown function or operator, or a Subtree that threw
+    };
+
+    // Variable values by slot, the slots a program resolved its variable
+    // names to. Sampling loops bind once and then overwrite one slot per
+    // point. A slot never set makes evaluation throw "Undefined variable"
+    // when it is reached, as the tree would.
+    class Environment {
+    public:
+        // Does nothing for slot -1, the slot of a name the program never reads
+        void set(int slot, double value) {
+            if (slot < 0) return;
+            if (!bound[slot]) {
+                bound[slot] = true;
+                --missing;
+            }
+            values[slot] = value;
+        }
+
+    private:
+        friend class CompiledExpression;
+        std::vector<double> values;
+        std::vector<char> bound;
+        size_t missing = 0;
+        // Only kept for Subtree instructions, which need names
+        std::unordered_map<std::string, double> byName;
+    };
+
+    CompiledExpression() = default;
+    explicit CompiledExpression(const std::shared_ptr<ExpressionNode>& root);
+    // The tree has to outlive the program when it contains node types only the
+    // tree knows how to evaluate
+    explicit CompiledExpression(const ExpressionNode& root);
+
+    // Slot of the variable called name, or -1 if the expression never reads it
+    int slotOf(const std::string& name) const;
+
+    // An environment with the slots of every name in variables set
+    Environment bind(const std::unordered_map<std::string, double>& variables) const;
+
+    double evaluate(const Environment& environment) const;
+    double evaluate(const std::unordered_map<std::string, double>& variables) const;
+
+    // Same as evaluate, but errors are returned instead of thrown, with result
+    // set to NaN. Loops that skip points where the function is undefined use
+    // this so a pole or an edge of the domain costs a branch, not an unwind.
+    Status tryEvaluate(const Environment& environment, double& result) const;
+
+    // Evaluates once per value in xs, put in slot, setting out[i] for xs[i].
+    // Points go through a block at a time, each instruction over the whole
+    // block, so the arithmetic loops vectorize. Domain errors and division by
+    // zero give NaN instead of throwing; an unset variable or unknown function
+    // would fail at every point and still throws.
+    void evaluateBatch(const Environment& environment, int slot,
+                       const std::vector<double>& xs, std::vector<double>& out) const;
+
+    bool empty() const { return code.empty(); }
+    const std::vector<Instruction>& instructions() const { return code; }
+
+private:
+    std::vector<Instruction> code;
+    std::vector<double> constants;
+    std::vector<std::string> names;
+    std::vector<std::string> messages;
+    std::vector<const ExpressionNode*> subtrees;
+    size_t maxDepth = 0;
+
+    struct Fault {
+        const Instruction* at = nullptr;
+        std::exception_ptr error;  // what a Subtree threw
+    };
+
+    void compile(const ExpressionNode& node, size_t depth);
+    void emit(OpCode op, uint32_t operand, size_t depth);
+    void fail(const std::string& message, size_t depth);
+    [[noreturn]] void raise(Status status, const Fault& fault) const;
+    template <bool CheckBound>
+    Status run(const Environment& environment, double& result, Fault& fault) const;
+};
+
+#endif
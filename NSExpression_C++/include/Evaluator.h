@@ -2,7 +2,9 @@
 #define EVALUATOR_H
 
 #include "Expression.h"
+#include "Bytecode.h"
 #include <memory>
+#include <vector>
 #include <unordered_map>
 #include <stdexcept>
 
@@ -10,6 +12,22 @@ class Evaluator {
     public:
     static double evaluate(const std::shared_ptr<ExpressionNode>& root, 
                           const std::unordered_map<std::string, double>& variables = {});
+
+    // For expressions evaluated many times: compile once, then evaluate the program
+    static CompiledExpression compile(const std::shared_ptr<ExpressionNode>& root);
+    static double evaluate(const CompiledExpression& program,
+                          const std::unordered_map<std::string, double>& variables = {});
+    // Does not throw for errors in the expression: result is NaN and the status says why
+    static CompiledExpression::Status tryEvaluate(const CompiledExpression& program, double& result,
+                          const std::unordered_map<std::string, double>& variables = {});
+
+    // Evaluates at every x in xs at once, writing out[i] for xs[i]; NaN where undefined
+    static void evaluateBatch(const std::shared_ptr<ExpressionNode>& root,
+                              const std::vector<double>& xs, std::vector<double>& out,
+                              const std::unordered_map<std::string, double>& variables = {});
+    static void evaluateBatch(const CompiledExpression& program,
+                              const std::vector<double>& xs, std::vector<double>& out,
+                              const std::unordered_map<std::string, double>& variables = {});
 };
 
 #endif
\ No newline at end of file
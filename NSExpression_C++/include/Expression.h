@@ -79,6 +79,8 @@ public:
     EquationNode(std::shared_ptr<ExpressionNode> left, std::shared_ptr<ExpressionNode> right);
     double evaluate(const std::unordered_map<std::string, double>& variables) const override;
     bool isEquation() const override;
+    std::shared_ptr<ExpressionNode> getLeft() const;
+    std::shared_ptr<ExpressionNode> getRight() const;
     double solveFor(const std::string& var, const std::unordered_map<std::string, double>& variables) const;
     std::vector<Complex> solveComplex(const std::string& var) const;
     std::vector<double> solveNonLinear(const std::string& var, const std::unordered_map<std::string, double>& variables) const;
@@ -0,0 +1,467 @@
+#include "Bytecode.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+// Deep enough for any expression typed at the prompt; deeper ones use the heap
+const size_t kInlineDepth = 32;
+
+// Points per evaluateBatch block: long enough loops to vectorize, while the
+// stack of columns stays in L1 for ordinary expressions
+const size_t kBatchBlock = 256;
+
+const double kNaN = std::numeric_limits<double>::quiet_NaN();
+
+template <typename F>
+void applyUnary(double* a, size_t n, F f) {
+    for (size_t i = 0; i < n; ++i) a[i] = f(a[i]);
+}
+
+template <typename F>
+void applyBinary(double* a, const double* b, size_t n, F f) {
+    for (size_t i = 0; i < n; ++i) a[i] = f(a[i], b[i]);
+}
+
+struct FunctionEntry {
+    const char* name;
+    CompiledExpression::OpCode op;
+};
+
+const FunctionEntry kFunctions[] = {
+    {"sin", CompiledExpression::OpCode::Sin},     {"cos", CompiledExpression::OpCode::Cos},
+    {"tan", CompiledExpression::OpCode::Tan},     {"asin", CompiledExpression::OpCode::Asin},
+    {"acos", CompiledExpression::OpCode::Acos},   {"atan", CompiledExpression::OpCode::Atan},
+    {"log", CompiledExpression::OpCode::Log},     {"ln", CompiledExpression::OpCode::Log},
+    {"log10", CompiledExpression::OpCode::Log10}, {"log2", CompiledExpression::OpCode::Log2},
+    {"exp", CompiledExpression::OpCode::Exp},     {"sqrt", CompiledExpression::OpCode::Sqrt},
+    {"cbrt", CompiledExpression::OpCode::Cbrt},
+};
+
+const ExpressionNode& checked(const std::shared_ptr<ExpressionNode>& node) {
+    if (!node) {
+        throw std::invalid_argument("Null expression node encountered");
+    }
+    return *node;
+}
+
+}
+
+CompiledExpression::CompiledExpression(const std::shared_ptr<ExpressionNode>& root) {
+    compile(checked(root), 0);
+}
+
+CompiledExpression::CompiledExpression(const ExpressionNode& root) {
+    compile(root, 0);
+}
+
+void CompiledExpression::emit(OpCode op, uint32_t operand, size_t depth) {
+    code.push_back({op, operand});
+    maxDepth = std::max(maxDepth, depth);
+}
+
+void CompiledExpression::fail(const std::string& message, size_t depth) {
+    messages.push_back(message);
+    emit(OpCode::Fail, static_cast<uint32_t>(messages.size() - 1), depth);
+}
+
+// Emits code leaving the node's value on top of a stack that holds depth
+// values before it runs. Operands come first, in the order the tree would
+// evaluate them, so the same error surfaces first.
+void CompiledExpression::compile(const ExpressionNode& node, size_t depth) {
+    if (auto number = dynamic_cast<const NumberNode*>(&node)) {
+        constants.push_back(number->getValue());
+        emit(OpCode::Constant, static_cast<uint32_t>(constants.size() - 1), depth + 1);
+    } else if (auto variable = dynamic_cast<const VariableNode*>(&node)) {
+        std::string name = variable->getName();
+        auto it = std::find(names.begin(), names.end(), name);
+        if (it == names.end()) it = names.insert(names.end(), name);
+        emit(OpCode::Variable, static_cast<uint32_t>(it - names.begin()), depth + 1);
+    } else if (auto bin = dynamic_cast<const BinaryOpNode*>(&node)) {
+        compile(checked(bin->getLeft()), depth);
+        compile(checked(bin->getRight()), depth + 1);
+        const std::string op = bin->getOp();
+        if (op == "+") emit(OpCode::Add, 0, depth + 1);
+        else if (op == "-") emit(OpCode::Subtract, 0, depth + 1);
+        else if (op == "*") emit(OpCode::Multiply, 0, depth + 1);
+        else if (op == "/") emit(OpCode::Divide, 0, depth + 1);
+        else if (op == "^") emit(OpCode::Power, 0, depth + 1);
+        else fail("Unknown operator: " + op, depth + 1);
+    } else if (auto unary = dynamic_cast<const UnaryOpNode*>(&node)) {
+        compile(checked(unary->getOperand()), depth);
+        if (unary->getOp() == "-") emit(OpCode::Negate, 0, depth + 1);
+        else fail("Unknown unary operator: " + unary->getOp(), depth + 1);
+    } else if (auto func = dynamic_cast<const FunctionNode*>(&node)) {
+        if (func->getArgs().size() != 1) {
+            fail("Only single-argument functions supported", depth + 1);
+            return;
+        }
+        compile(checked(func->getArgs()[0]), depth);
+        const std::string name = func->getName();
+        for (const auto& entry : kFunctions) {
+            if (name == entry.name) {
+                emit(entry.op, 0, depth + 1);
+                return;
+            }
+        }
+        fail("Unknown function: " + name, depth + 1);
+    } else if (auto equation = dynamic_cast<const EquationNode*>(&node)) {
+        compile(checked(equation->getLeft()), depth);
+        compile(checked(equation->getRight()), depth + 1);
+        emit(OpCode::Subtract, 0, depth + 1);
+    } else {
+        subtrees.push_back(&node);
+        emit(OpCode::Subtree, static_cast<uint32_t>(subtrees.size() - 1), depth + 1);
+    }
+}
+
+int CompiledExpression::slotOf(const std::string& name) const {
+    auto it = std::find(names.begin(), names.end(), name);
+    return it == names.end() ? -1 : static_cast<int>(it - names.begin());
+}
+
+CompiledExpression::Environment CompiledExpression::bind(const std::unordered_map<std::string, double>& variables) const {
+    Environment environment;
+    environment.values.assign(names.size(), 0.0);
+    environment.bound.assign(names.size(), false);
+    environment.missing = names.size();
+    for (size_t slot = 0; slot < names.size(); ++slot) {
+        auto it = variables.find(names[slot]);
+        if (it != variables.end()) environment.set(static_cast<int>(slot), it->second);
+    }
+    if (!subtrees.empty()) environment.byName = variables;
+    return environment;
+}
+
+double CompiledExpression::evaluate(const Environment& environment) const {
+    if (code.empty()) {
+        throw std::invalid_argument("Null expression node encountered");
+    }
+    double result;
+    Fault fault;
+    Status status = environment.missing == 0 ? run<false>(environment, result, fault)
+                                             : run<true>(environment, result, fault);
+    if (status != Status::Ok) {
+        raise(status, fault);
+    }
+    return result;
+}
+
+double CompiledExpression::evaluate(const std::unordered_map<std::string, double>& variables) const {
+    return evaluate(bind(variables));
+}
+
+CompiledExpression::Status CompiledExpression::tryEvaluate(const Environment& environment, double& result) const {
+    if (code.empty()) {
+        result = kNaN;
+        return Status::Failed;
+    }
+    Fault fault;
+    Status status = environment.missing == 0 ? run<false>(environment, result, fault)
+                                             : run<true>(environment, result, fault);
+    if (status != Status::Ok) {
+        result = kNaN;
+    }
+    return status;
+}
+
+// Rebuilds the exception the tree would have thrown for a failed run
+void CompiledExpression::raise(Status status, const Fault& fault) const {
+    if (fault.error) {
+        std::rethrow_exception(fault.error);
+    }
+    switch (status) {
+        case Status::DivisionByZero:
+            throw std::runtime_error("Division by zero");
+        case Status::UndefinedVariable:
+            throw std::runtime_error("Undefined variable: " + names[fault.at->operand]);
+        case Status::DomainError:
+            switch (fault.at->op) {
+                case OpCode::Asin: throw std::runtime_error("asin domain error");
+                case OpCode::Acos: throw std::runtime_error("acos domain error");
+                case OpCode::Log: throw std::runtime_error("Logarithm undefined for non-positive argument");
+                case OpCode::Log10: throw std::runtime_error("Log10 undefined for non-positive argument");
+                case OpCode::Log2: throw std::runtime_error("Log2 undefined for non-positive argument");
+                case OpCode::Sqrt: throw std::runtime_error("Square root undefined for negative argument");
+                default: break;
+            }
+            break;
+        case Status::Failed:
+            throw std::runtime_error(messages[fault.at->operand]);
+        case Status::Ok:
+            break;
+    }
+    throw std::logic_error("Unexpected evaluation status");
+}
+
+// Only environments with unset slots pay for checking each variable read.
+// Errors come back as a status so sampling loops never unwind; fault says
+// which instruction stopped the run.
+template <bool CheckBound>
+CompiledExpression::Status CompiledExpression::run(const Environment& environment, double& result,
+                                                   Fault& fault) const {
+    double inlineStack[kInlineDepth];
+    std::vector<double> heapStack;
+    double* top = inlineStack;  // one past the topmost value
+    if (maxDepth > kInlineDepth) {
+        heapStack.resize(maxDepth);
+        top = heapStack.data();
+    }
+
+    for (const Instruction& inst : code) {
+        switch (inst.op) {
+            case OpCode::Constant:
+                *top++ = constants[inst.operand];
+                break;
+            case OpCode::Variable:
+                if (CheckBound && !environment.bound[inst.operand]) {
+                    fault.at = &inst;
+                    return Status::UndefinedVariable;
+                }
+                *top++ = environment.values[inst.operand];
+                break;
+            case OpCode::Add:
+                --top;
+                top[-1] += top[0];
+                break;
+            case OpCode::Subtract:
+                --top;
+                top[-1] -= top[0];
+                break;
+            case OpCode::Multiply:
+                --top;
+                top[-1] *= top[0];
+                break;
+            case OpCode::Divide:
+                --top;
+                if (std::abs(top[0]) < 1e-10) {
+                    fault.at = &inst;
+                    return Status::DivisionByZero;
+                }
+                top[-1] /= top[0];
+                break;
+            case OpCode::Power:
+                --top;
+                top[-1] = std::pow(top[-1], top[0]);
+                break;
+            case OpCode::Negate:
+                top[-1] = -top[-1];
+                break;
+            case OpCode::Sin:
+                top[-1] = std::sin(top[-1]);
+                break;
+            case OpCode::Cos:
+                top[-1] = std::cos(top[-1]);
+                break;
+            case OpCode::Tan:
+                top[-1] = std::tan(top[-1]);
+                break;
+            case OpCode::Asin:
+                if (top[-1] < -1 || top[-1] > 1) {
+                    fault.at = &inst;
+                    return Status::DomainError;
+                }
+                top[-1] = std::asin(top[-1]);
+                break;
+            case OpCode::Acos:
+                if (top[-1] < -1 || top[-1] > 1) {
+                    fault.at = &inst;
+                    return Status::DomainError;
+                }
+                top[-1] = std::acos(top[-1]);
+                break;
+            case OpCode::Atan:
+                top[-1] = std::atan(top[-1]);
+                break;
+            case OpCode::Log:
+                if (top[-1] <= 0) {
+                    fault.at = &inst;
+                    return Status::DomainError;
+                }
+                top[-1] = std::log(top[-1]);
+                break;
+            case OpCode::Log10:
+                if (top[-1] <= 0) {
+                    fault.at = &inst;
+                    return Status::DomainError;
+                }
+                top[-1] = std::log10(top[-1]);
+                break;
+            case OpCode::Log2:
+                if (top[-1] <= 0) {
+                    fault.at = &inst;
+                    return Status::DomainError;
+                }
+                top[-1] = std::log2(top[-1]);
+                break;
+            case OpCode::Exp:
+                top[-1] = std::exp(top[-1]);
+                break;
+            case OpCode::Sqrt:
+                if (top[-1] < 0) {
+                    fault.at = &inst;
+                    return Status::DomainError;
+                }
+                top[-1] = std::sqrt(top[-1]);
+                break;
+            case OpCode::Cbrt:
+                top[-1] = std::cbrt(top[-1]);
+                break;
+            case OpCode::Subtree: {
+                std::unordered_map<std::string, double> variables = environment.byName;
+                for (size_t slot = 0; slot < names.size(); ++slot) {
+                    if (environment.bound[slot]) variables[names[slot]] = environment.values[slot];
+                }
+                // The tree only reports errors by throwing; keep the exception
+                // so evaluate can rethrow it unchanged
+                try {
+                    *top++ = subtrees[inst.operand]->evaluate(variables);
+                } catch (...) {
+                    fault.at = &inst;
+                    fault.error = std::current_exception();
+                    return Status::Failed;
+                }
+                break;
+            }
+            case OpCode::Fail:
+                fault.at = &inst;
+                return Status::Failed;
+        }
+    }
+    result = top[-1];
+    return Status::Ok;
+}
+
+void CompiledExpression::evaluateBatch(const Environment& environment, int slot,
+                                       const std::vector<double>& xs, std::vector<double>& out) const {
+    if (code.empty()) {
+        throw std::invalid_argument("Null expression node encountered");
+    }
+    out.resize(xs.size());
+    // Errors that do not depend on the point are raised once, up front
+    for (const Instruction& inst : code) {
+        if (inst.op == OpCode::Variable && static_cast<int>(inst.operand) != slot && !environment.bound[inst.operand]) {
+            throw std::runtime_error("Undefined variable: " + names[inst.operand]);
+        }
+        if (inst.op == OpCode::Fail) {
+            throw std::runtime_error(messages[inst.operand]);
+        }
+    }
+
+    // One column of kBatchBlock values per stack entry, after a spare one so
+    // the topmost column can be named before anything is pushed
+    std::vector<double> columns((maxDepth + 1) * kBatchBlock);
+    double* bottom = columns.data() + kBatchBlock;
+    for (size_t begin = 0; begin < xs.size(); begin += kBatchBlock) {
+        const size_t n = std::min(kBatchBlock, xs.size() - begin);
+        double* top = bottom;  // the column after the topmost value
+
+        for (const Instruction& inst : code) {
+            double* a = top - kBatchBlock;
+            switch (inst.op) {
+                case OpCode::Constant:
+                    std::fill(top, top + n, constants[inst.operand]);
+                    top += kBatchBlock;
+                    break;
+                case OpCode::Variable:
+                    if (static_cast<int>(inst.operand) == slot) {
+                        std::copy(xs.begin() + begin, xs.begin() + begin + n, top);
+                    } else {
+                        std::fill(top, top + n, environment.values[inst.operand]);
+                    }
+                    top += kBatchBlock;
+                    break;
+                case OpCode::Add:
+                    top = a;
+                    applyBinary(a - kBatchBlock, a, n, [](double l, double r) { return l + r; });
+                    break;
+                case OpCode::Subtract:
+                    top = a;
+                    applyBinary(a - kBatchBlock, a, n, [](double l, double r) { return l - r; });
+                    break;
+                case OpCode::Multiply:
+                    top = a;
+                    applyBinary(a - kBatchBlock, a, n, [](double l, double r) { return l * r; });
+                    break;
+                case OpCode::Divide:
+                    top = a;
+                    // Divide first and select after, which keeps the loop branch-free
+                    applyBinary(a - kBatchBlock, a, n, [](double l, double r) {
+                        double quotient = l / r;
+                        return std::abs(r) < 1e-10 ? kNaN : quotient;
+                    });
+                    break;
+                case OpCode::Power:
+                    top = a;
+                    // pow(NaN, 0) and pow(1, NaN) are 1, which would hide an error in an operand
+                    applyBinary(a - kBatchBlock, a, n, [](double l, double r) {
+                        return std::isnan(l) || std::isnan(r) ? kNaN : std::pow(l, r);
+                    });
+                    break;
+                case OpCode::Negate:
+                    applyUnary(a, n, [](double v) { return -v; });
+                    break;
+                case OpCode::Sin:
+                    applyUnary(a, n, [](double v) { return std::sin(v); });
+                    break;
+                case OpCode::Cos:
+                    applyUnary(a, n, [](double v) { return std::cos(v); });
+                    break;
+                case OpCode::Tan:
+                    applyUnary(a, n, [](double v) { return std::tan(v); });
+                    break;
+                case OpCode::Asin:
+                    applyUnary(a, n, [](double v) { return v < -1 || v > 1 ? kNaN : std::asin(v); });
+                    break;
+                case OpCode::Acos:
+                    applyUnary(a, n, [](double v) { return v < -1 || v > 1 ? kNaN : std::acos(v); });
+                    break;
+                case OpCode::Atan:
+                    applyUnary(a, n, [](double v) { return std::atan(v); });
+                    break;
+                case OpCode::Log:
+                    applyUnary(a, n, [](double v) { return v <= 0 ? kNaN : std::log(v); });
+                    break;
+                case OpCode::Log10:
+                    applyUnary(a, n, [](double v) { return v <= 0 ? kNaN : std::log10(v); });
+                    break;
+                case OpCode::Log2:
+                    applyUnary(a, n, [](double v) { return v <= 0 ? kNaN : std::log2(v); });
+                    break;
+                case OpCode::Exp:
+                    applyUnary(a, n, [](double v) { return std::exp(v); });
+                    break;
+                case OpCode::Sqrt:
+                    applyUnary(a, n, [](double v) {
+                        double root = std::sqrt(v);
+                        return v < 0 ? kNaN : root;
+                    });
+                    break;
+                case OpCode::Cbrt:
+                    applyUnary(a, n, [](double v) { return std::cbrt(v); });
+                    break;
+                case OpCode::Subtree: {
+                    std::unordered_map<std::string, double> variables = environment.byName;
+                    for (size_t s = 0; s < names.size(); ++s) {
+                        if (environment.bound[s]) variables[names[s]] = environment.values[s];
+                    }
+                    for (size_t i = 0; i < n; ++i) {
+                        if (slot >= 0) variables[names[slot]] = xs[begin + i];
+                        try {
+                            top[i] = subtrees[inst.operand]->evaluate(variables);
+                        } catch (const std::exception&) {
+                            top[i] = kNaN;
+                        }
+                    }
+                    top += kBatchBlock;
+                    break;
+                }
+                case OpCode::Fail:
+                    throw std::runtime_error(messages[inst.operand]);
+            }
+        }
+        std::copy(bottom, bottom + n, out.begin() + begin);
+    }
+}
@@ -6,4 +6,30 @@ double Evaluator::evaluate(const std::shared_ptr<ExpressionNode>& root,
         throw std::invalid_argument("Null expression node encountered");
     }
     return root->evaluate(variables);
+}
+
+CompiledExpression Evaluator::compile(const std::shared_ptr<ExpressionNode>& root) {
+    return CompiledExpression(root);
+}
+
+double Evaluator::evaluate(const CompiledExpression& program,
+                          const std::unordered_map<std::string, double>& variables) {
+    return program.evaluate(variables);
+}
+
+CompiledExpression::Status Evaluator::tryEvaluate(const CompiledExpression& program, double& result,
+                          const std::unordered_map<std::string, double>& variables) {
+    return program.tryEvaluate(program.bind(variables), result);
+}
+
+void Evaluator::evaluateBatch(const std::shared_ptr<ExpressionNode>& root,
+                              const std::vector<double>& xs, std::vector<double>& out,
+                              const std::unordered_map<std::string, double>& variables) {
+    evaluateBatch(CompiledExpression(root), xs, out, variables);
+}
+
+void Evaluator::evaluateBatch(const CompiledExpression& program,
+                              const std::vector<double>& xs, std::vector<double>& out,
+                              const std::unordered_map<std::string, double>& variables) {
+    program.evaluateBatch(program.bind(variables), program.slotOf("x"), xs, out);
 }
\ No newline at end of file
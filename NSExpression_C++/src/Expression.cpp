@@ -1,4 +1,5 @@
 #include "Expression.h"
+#include "Bytecode.h"
 #include <algorithm>
 #include <cmath>
 #include <unordered_map>
@@ -17,11 +18,16 @@ bool EquationNode::isEquation() const {
     return true;
 }
 
+std::shared_ptr<ExpressionNode> EquationNode::getLeft() const { return left; }
+std::shared_ptr<ExpressionNode> EquationNode::getRight() const { return right; }
+
 std::vector<double> EquationNode::solveNonLinear(const std::string& var, const std::unordered_map<std::string, double>& variables) const {
+    CompiledExpression program(*this);
+    CompiledExpression::Environment env = program.bind(variables);
+    int slot = program.slotOf(var);
     auto f = [&](double x) {
-        std::unordered_map<std::string, double> vars = variables;
-        vars[var] = x;
-        return left->evaluate(vars) - right->evaluate(vars);
+        env.set(slot, x);
+        return program.evaluate(env);
     };
 
     auto df = [&](double x) {
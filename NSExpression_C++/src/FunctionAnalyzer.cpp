@@ -14,7 +14,25 @@ constexpr double PLOT_MAX = 10.0;
 constexpr double PLOT_STEP = 0.1;
 constexpr double EPSILON = 1e-10;
 
-FunctionAnalyzer::FunctionAnalyzer(const std::shared_ptr<ExpressionNode>& expr) : expr(expr) {}
+namespace {
+
+// The x values a scan from minX to maxX visits, accumulated the way the
+// loops always stepped. An infinite end is cut to the plot window, since a
+// scan from there would never finish.
+std::vector<double> sampleGrid(double minX, double maxX, double step) {
+    if (minX == -std::numeric_limits<double>::infinity()) minX = PLOT_MIN;
+    if (maxX == std::numeric_limits<double>::infinity()) maxX = PLOT_MAX;
+    std::vector<double> xs;
+    for (double x = minX; x <= maxX; x += step) {
+        xs.push_back(x);
+    }
+    return xs;
+}
+
+}
+
+FunctionAnalyzer::FunctionAnalyzer(const std::shared_ptr<ExpressionNode>& expr)
+    : expr(expr), program(expr), xSlot(program.slotOf("x")) {}
 
 std::vector<std::pair<double, double>> FunctionAnalyzer::getRestrictedDomain(const std::shared_ptr<ExpressionNode>& node) const {
     // [Unchanged code from your original FunctionAnalyzer.cpp]
@@ -68,22 +86,14 @@ std::vector<std::pair<double, double>> FunctionAnalyzer::getRestrictedDomain(con
             }
             std::vector<std::pair<double, double>> intervals;
             double last = PLOT_MIN;
-            std::unordered_map<std::string, double> vars;
+            CompiledExpression denominator(bin->getRight());
+            CompiledExpression::Environment env = denominator.bind({});
+            int denominatorSlot = denominator.slotOf("x");
             bool open = true;
             for (double x = PLOT_MIN; x <= PLOT_MAX + EPSILON; x += PLOT_STEP) {
-                vars["x"] = x;
-                try {
-                    double denom = bin->getRight()->evaluate(vars);
-                    if (std::abs(denom) < EPSILON && open) {
-                        if (x - last > EPSILON) {
-                            intervals.emplace_back(last, x - EPSILON);
-                        }
-                        last = x + EPSILON;
-                        open = false;
-                    } else if (std::abs(denom) >= EPSILON && !open) {
-                        open = true;
-                    }
-                } catch (const std::exception&) {
+                env.set(denominatorSlot, x);
+                double denom;
+                if (denominator.tryEvaluate(env, denom) != CompiledExpression::Status::Ok) {
                     if (open) {
                         if (x - last > EPSILON) {
                             intervals.emplace_back(last, x - EPSILON);
@@ -91,6 +101,14 @@ std::vector<std::pair<double, double>> FunctionAnalyzer::getRestrictedDomain(con
                         last = x + EPSILON;
                         open = false;
                     }
+                } else if (std::abs(denom) < EPSILON && open) {
+                    if (x - last > EPSILON) {
+                        intervals.emplace_back(last, x - EPSILON);
+                    }
+                    last = x + EPSILON;
+                    open = false;
+                } else if (std::abs(denom) >= EPSILON && !open) {
+                    open = true;
                 }
             }
             if (open && PLOT_MAX - last > EPSILON) {
@@ -117,6 +135,17 @@ std::vector<std::pair<double, double>> FunctionAnalyzer::getRestrictedDomain(con
     return { {-std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()} };
 }
 
+std::vector<double> FunctionAnalyzer::evaluateAt(const std::vector<double>& xs) const {
+    std::vector<double> ys(xs.size());
+    try {
+        program.evaluateBatch(program.bind({}), xSlot, xs, ys);
+    } catch (const std::exception&) {
+        // Fails the same way at every point, so none of them is defined
+        std::fill(ys.begin(), ys.end(), std::numeric_limits<double>::quiet_NaN());
+    }
+    return ys;
+}
+
 std::vector<std::pair<double, double>> FunctionAnalyzer::getDomain() const {
     return getRestrictedDomain(expr);
 }
@@ -174,21 +203,15 @@ std::pair<double, double> FunctionAnalyzer::getRange() const {
     auto domains = getDomain();
     double minY = std::numeric_limits<double>::infinity();
     double maxY = -std::numeric_limits<double>::infinity();
-    std::unordered_map<std::string, double> vars;
     for (const auto& domain : domains) {
-        double minX = domain.first;
-        double maxX = domain.second;
-        for (double x = minX; x <= maxX; x += PLOT_STEP) {
-            if (std::abs(x) < EPSILON) continue;
-            vars["x"] = x;
-            try {
-                double y = expr->evaluate(vars);
-                if (std::isfinite(y)) {
-                    minY = std::min(minY, y);
-                    maxY = std::max(maxY, y);
-                }
-            } catch (const std::exception&) {
-                // Skip undefined points
+        std::vector<double> xs = sampleGrid(domain.first, domain.second, PLOT_STEP);
+        std::vector<double> ys = evaluateAt(xs);
+        for (size_t i = 0; i < xs.size(); ++i) {
+            if (std::abs(xs[i]) < EPSILON) continue;
+            // Undefined points are NaN and skipped
+            if (std::isfinite(ys[i])) {
+                minY = std::min(minY, ys[i]);
+                maxY = std::max(maxY, ys[i]);
             }
         }
     }
@@ -233,21 +256,18 @@ bool FunctionAnalyzer::isOdd() const {
     if (!std::isinf(domains[0].first) && domains[0].first >= 0) {
         return false;
     }
-    std::unordered_map<std::string, double> vars;
     bool hasValidPoint = false;
     for (const auto& domain : domains) {
-        double minX = domain.first;
-        double maxX = domain.second;
-        for (double x = minX; x <= maxX; x += PLOT_STEP) {
+        std::vector<double> xs = sampleGrid(domain.first, domain.second, PLOT_STEP);
+        std::vector<double> negated(xs.size());
+        std::transform(xs.begin(), xs.end(), negated.begin(), [](double x) { return -x; });
+        std::vector<double> values = evaluateAt(xs);
+        std::vector<double> negatedValues = evaluateAt(negated);
+        for (size_t i = 0; i < xs.size(); ++i) {
+            double x = xs[i];
             if (std::abs(x) < EPSILON) continue;
-            vars["x"] = x;
-            double f_x;
-            try {
-                f_x = expr->evaluate(vars);
-            } catch (const std::exception&) {
-                continue;
-            }
-            vars["x"] = -x;
+            double f_x = values[i];
+            if (std::isnan(f_x)) continue;
             bool inDomain = false;
             for (const auto& d : domains) {
                 if (-x >= d.first - EPSILON && -x <= d.second + EPSILON) {
@@ -256,12 +276,8 @@ bool FunctionAnalyzer::isOdd() const {
                 }
             }
             if (!inDomain) continue;
-            double f_neg_x;
-            try {
-                f_neg_x = expr->evaluate(vars);
-            } catch (const std::exception&) {
-                continue;
-            }
+            double f_neg_x = negatedValues[i];
+            if (std::isnan(f_neg_x)) continue;
             if (std::abs(f_x + f_neg_x) > EPSILON) {
                 return false;
             }
@@ -305,21 +321,18 @@ bool FunctionAnalyzer::isEven() const {
     if (!std::isinf(domains[0].first) && domains[0].first >= 0) {
         return false;
     }
-    std::unordered_map<std::string, double> vars;
     bool hasValidPoint = false;
     for (const auto& domain : domains) {
-        double minX = domain.first;
-        double maxX = domain.second;
-        for (double x = minX; x <= maxX; x += PLOT_STEP) {
+        std::vector<double> xs = sampleGrid(domain.first, domain.second, PLOT_STEP);
+        std::vector<double> negated(xs.size());
+        std::transform(xs.begin(), xs.end(), negated.begin(), [](double x) { return -x; });
+        std::vector<double> values = evaluateAt(xs);
+        std::vector<double> negatedValues = evaluateAt(negated);
+        for (size_t i = 0; i < xs.size(); ++i) {
+            double x = xs[i];
             if (std::abs(x) < EPSILON) continue;
-            vars["x"] = x;
-            double f_x;
-            try {
-                f_x = expr->evaluate(vars);
-            } catch (const std::exception&) {
-                continue;
-            }
-            vars["x"] = -x;
+            double f_x = values[i];
+            if (std::isnan(f_x)) continue;
             bool inDomain = false;
             for (const auto& d : domains) {
                 if (-x >= d.first - EPSILON && -x <= d.second + EPSILON) {
@@ -328,12 +341,8 @@ bool FunctionAnalyzer::isEven() const {
                 }
             }
             if (!inDomain) continue;
-            double f_neg_x;
-            try {
-                f_neg_x = expr->evaluate(vars);
-            } catch (const std::exception&) {
-                continue;
-            }
+            double f_neg_x = negatedValues[i];
+            if (std::isnan(f_neg_x)) continue;
             if (std::abs(f_x - f_neg_x) > EPSILON) {
                 return false;
             }
@@ -417,30 +426,24 @@ std::vector<std::pair<double, double>> FunctionAnalyzer::getXAxisIntercepts() co
 
     auto domains = getDomain();
     std::vector<std::pair<double, double>> intercepts;
-    std::unordered_map<std::string, double> vars;
     for (const auto& domain : domains) {
-        double minX = domain.first;
-        double maxX = domain.second;
-        for (double x = minX; x <= maxX; x += PLOT_STEP / 10) {
+        std::vector<double> xs = sampleGrid(domain.first, domain.second, PLOT_STEP / 10);
+        std::vector<double> previous(xs.size());
+        std::transform(xs.begin(), xs.end(), previous.begin(), [](double x) { return x - PLOT_STEP / 10; });
+        std::vector<double> ys = evaluateAt(xs);
+        std::vector<double> previousYs = evaluateAt(previous);
+        for (size_t i = 0; i < xs.size(); ++i) {
+            double x = xs[i];
             if (std::abs(x) < EPSILON) continue;
-            vars["x"] = x;
-            try {
-                double y = expr->evaluate(vars);
-                if (std::abs(y) < EPSILON) {
-                    intercepts.emplace_back(x, 0.0);
-                } else {
-                    vars["x"] = x - PLOT_STEP / 10;
-                    try {
-                        double y_prev = expr->evaluate(vars);
-                        if (y * y_prev < 0 && std::isfinite(y) && std::isfinite(y_prev)) {
-                            intercepts.emplace_back(x - PLOT_STEP / 20, 0.0);
-                        }
-                    } catch (const std::exception&) {
-                        // Skip undefined points
-                    }
+            // NaN marks undefined points, which never count as crossings
+            double y = ys[i];
+            if (std::abs(y) < EPSILON) {
+                intercepts.emplace_back(x, 0.0);
+            } else {
+                double y_prev = previousYs[i];
+                if (y * y_prev < 0 && std::isfinite(y) && std::isfinite(y_prev)) {
+                    intercepts.emplace_back(x - PLOT_STEP / 20, 0.0);
                 }
-            } catch (const std::exception&) {
-                // Skip undefined points
             }
         }
     }
@@ -473,14 +476,13 @@ std::pair<double, double> FunctionAnalyzer::getYAxisIntercept() const {
     if (!includesZero) {
         return { 0.0, std::numeric_limits<double>::quiet_NaN() };
     }
-    std::unordered_map<std::string, double> vars;
-    vars["x"] = 0.0;
-    try {
-        double y = expr->evaluate(vars);
-        return { 0.0, std::abs(y) < EPSILON ? 0.0 : y };
-    } catch (const std::exception&) {
+    CompiledExpression::Environment env = program.bind({});
+    env.set(xSlot, 0.0);
+    double y;
+    if (program.tryEvaluate(env, y) != CompiledExpression::Status::Ok) {
         return { 0.0, std::numeric_limits<double>::quiet_NaN() };
     }
+    return { 0.0, std::abs(y) < EPSILON ? 0.0 : y };
 }
 
 void FunctionAnalyzer::plotNcurses(const std::string& filename) const {
@@ -539,19 +541,14 @@ void FunctionAnalyzer::plotNcurses(const std::string& filename) const {
 
         // Calculate points
         coordinates.clear();
-        std::unordered_map<std::string, double> vars;
         bool hasFiniteValues = false;
         double step = PLOT_STEP * zoom;
-        for (double x = current_minX; x <= current_maxX + step / 2; x += step) {
-            vars["x"] = x;
-            try {
-                double y = expr->evaluate(vars);
-                if (std::isfinite(y)) {
-                    coordinates.emplace_back(x, y);
-                    hasFiniteValues = true;
-                }
-            } catch (const std::exception&) {
-                // Skip invalid points
+        std::vector<double> xs = sampleGrid(current_minX, current_maxX + step / 2, step);
+        std::vector<double> ys = evaluateAt(xs);
+        for (size_t i = 0; i < xs.size(); ++i) {
+            if (std::isfinite(ys[i])) {
+                coordinates.emplace_back(xs[i], ys[i]);
+                hasFiniteValues = true;
             }
         }
 
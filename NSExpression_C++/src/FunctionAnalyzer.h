@@ -2,6 +2,7 @@
 #define FUNCTION_ANALYZER_H
 
 #include "Expression.h"
+#include "Bytecode.h"
 #include <vector>
 #include <memory>
 #include <string>
@@ -29,7 +30,12 @@ public:
 
 private:
     std::shared_ptr<ExpressionNode> expr;
+    // expr compiled once for the sampling loops, which only ever set x
+    CompiledExpression program;
+    int xSlot;
     std::vector<std::pair<double, double>> getRestrictedDomain(const std::shared_ptr<ExpressionNode>& node) const;
+    // program at every x in one batch; NaN where it is undefined
+    std::vector<double> evaluateAt(const std::vector<double>& xs) const;
 };
 
 #endif // FUNCTION_ANALYZER_H 
\ No newline at end of file